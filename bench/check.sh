@@ -0,0 +1,55 @@
+#!/bin/sh
+# codegen regression gate: runs every program in bench/programs in the emulator (cminus --trace)
+# and fails if one executes more instructions than recorded in bench/counts.txt, or exits with a non-zero code
+# flags change the code, so every set of flags has its own baseline: -m64 is checked against bench/counts-m64.txt
+# usage: bench/check.sh [--update] [cminus flags]
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+update=0
+if [ "$1" = "--update" ]; then update=1; shift; fi
+
+suffix=$(printf '%s' "$*" | sed 's/^ *-*//; s/  *-*/-/g; s/[^A-Za-z0-9_=-]/_/g')
+COUNTS="$ROOT/bench/counts${suffix:+-$suffix}.txt"
+
+status=0
+: > "$WORK/counts.txt"
+for program in "$ROOT"/bench/programs/*.c; do
+    name=$(basename "$program" .c)
+    cp "$program" "$WORK/$name.c"
+
+    (cd "$WORK" && "$ROOT/cminus" --trace "$@" "$name.c" > "$WORK/$name.trace")
+    total=$(awk '$1 == "total" { print $2 }' "$WORK/$name.trace")
+    if [ -z "$total" ]; then
+        echo "$name: failed to run" >&2
+        status=1
+        continue
+    fi
+
+    # programs check their own results and exit with 0 when they are right
+    code=$(sed -n 's/.*exit code \([0-9]*\)$/\1/p' "$WORK/$name.trace")
+    if [ "$code" != "0" ]; then
+        echo "$name: exit code ${code:-none}, expected 0 (wrong result)"
+        status=1
+    fi
+
+    echo "$name $total" >> "$WORK/counts.txt"
+    expected=$(awk -v name="$name" '$1 == name { print $2 }' "$COUNTS" 2>/dev/null)
+    if [ -z "$expected" ]; then
+        echo "$name: $total instructions (no baseline)"
+    elif [ "$total" -gt "$expected" ]; then
+        echo "$name: $total instructions, baseline $expected (regression)"
+        status=1
+    else
+        echo "$name: $total instructions, baseline $expected"
+    fi
+done
+
+if [ $update -eq 1 ]; then
+    cp "$WORK/counts.txt" "$COUNTS"
+    exit 0
+fi
+
+exit $status
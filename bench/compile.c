@@ -0,0 +1,109 @@
+/*
+    times the compiler on a generated program
+
+    usage: compile [-n iterations] [-o results] name file.c
+    a summary is printed and one JSON line per run is appended to the results file
+*/
+
+#define CMINUS_PARSER_IMPLEMENTATION
+#include <cminus_parser.h>
+
+/* global initializers are evaluated in the emulator */
+#define CMINUS_EMU_IMPLEMENTATION
+#include <cminus_emu.h>
+
+#include <time.h>
+#include <sys/resource.h>
+
+char string_buffer[0x10000];
+
+double time_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+int main(int argc, char** argv) {
+    size_t iterations = 10;
+    char* results = "bench_output.txt";
+    char* name = NULL;
+    char* path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            iterations = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            results = argv[++i];
+        else if (name == NULL)
+            name = argv[i];
+        else
+            path = argv[i];
+    }
+
+    if (path == NULL) {
+        fprintf(stderr, "usage: %s [-n iterations] [-o results] name file.c\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", path);
+        return 1;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    size_t size = ftell(file);
+    char* text = (char*)malloc(size);
+    fseek(file, 0L, SEEK_SET);
+    size = fread(text, 1, size, file);
+    fclose(file);
+
+    size_t lines = 0;
+    for (size_t i = 0; i < size; i++)
+        lines += (text[i] == '\n');
+
+    /* best of n, the first run also warms up the sym tables */
+    double lex_ms = 1e30, compile_ms = 1e30;
+    size_t tokens = 0, output_bytes = 0;
+    FILE* null = fopen("/dev/null", "w");
+    for (size_t n = 0; n < iterations; n++) {
+        double start = time_ms();
+        stb_lexer lex;
+        stb_c_lexer_init(&lex, text, text + size, string_buffer, sizeof(string_buffer));
+        for (tokens = 0; stb_c_lexer_get_token(&lex); tokens++);
+        double elapsed = time_ms() - start;
+        if (elapsed < lex_ms) lex_ms = elapsed;
+
+        /* the output is discarded, but counted once below */
+        start = time_ms();
+        cminus_parse(text, size, string_buffer, sizeof(string_buffer), null, 0);
+        elapsed = time_ms() - start;
+        if (elapsed < compile_ms) compile_ms = elapsed;
+    }
+    fclose(null);
+
+    FILE* output = tmpfile();
+    cminus_parse(text, size, string_buffer, sizeof(string_buffer), output, 0);
+    output_bytes = ftell(output);
+    fclose(output);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    double seconds = compile_ms / 1000.0;
+    printf("%-10s %8lu lines %9lu tokens  lex %8.3f ms  compile %8.3f ms  %11.0f tokens/s %10.0f lines/s  %6ld KB rss  %9lu bytes out\n",
+            name, lines, tokens, lex_ms, compile_ms, tokens / seconds, lines / seconds, usage.ru_maxrss, output_bytes);
+
+    FILE* out = fopen(results, "a");
+    if (out == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", results);
+        return 1;
+    }
+
+    fprintf(out, "{\"name\": \"%s\", \"lines\": %lu, \"tokens\": %lu, \"lex_ms\": %.3f, \"parse_emit_ms\": %.3f, \"compile_ms\": %.3f, "
+                 "\"tokens_per_sec\": %.0f, \"lines_per_sec\": %.0f, \"peak_rss_kb\": %ld, \"output_bytes\": %lu}\n",
+            name, lines, tokens, lex_ms, compile_ms - lex_ms, compile_ms, tokens / seconds, lines / seconds, usage.ru_maxrss, output_bytes);
+    fclose(out);
+    free(text);
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+    generates a cminus program for the compile time benchmarks
+
+    usage: gen [-f functions] [-g globals] [-l locals per scope] [-a args] [-d nesting depth]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SYMS 1024
+#define MAX_ARGS 20
+
+size_t functions = 100, globals = 100, locals = 8, args = 4, depth = 1;
+
+/* value for a local, only globals and constants are visible from nested scopes */
+void write_value(size_t i, size_t scope) {
+    if (i % 3 == 0 || globals == 0)
+        printf("%lu", i);
+    else if (i % 3 == 1 || scope > 0 || args == 0)
+        printf("g%lu", i % globals);
+    else
+        printf("a%lu", i % args);
+}
+
+void write_scope(size_t func, size_t scope) {
+    for (size_t i = 0; i < scope; i++) printf("    ");
+    printf("{\n");
+
+    for (size_t i = 0; i < locals; i++) {
+        for (size_t j = 0; j <= scope; j++) printf("    ");
+        printf("int l%lu = ", i);
+        write_value(func + i, scope);
+        printf(";\n");
+    }
+
+    if (globals && locals) {
+        for (size_t j = 0; j <= scope; j++) printf("    ");
+        printf("g%lu = l%lu;\n", func % globals, func % locals);
+    }
+
+    if (scope < depth)
+        write_scope(func, scope + 1);
+
+    if (func) {
+        for (size_t j = 0; j <= scope; j++) printf("    ");
+        printf("f%lu(", func - 1);
+        for (size_t i = 0; i < args; i++) {
+            if (i) printf(", ");
+            write_value(func + i, scope);
+        }
+        printf(");\n");
+    }
+
+    for (size_t i = 0; i < scope; i++) printf("    ");
+    printf("}\n");
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        size_t value = strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "-f") == 0) functions = value;
+        else if (strcmp(argv[i], "-g") == 0) globals = value;
+        else if (strcmp(argv[i], "-l") == 0) locals = value;
+        else if (strcmp(argv[i], "-a") == 0) args = value;
+        else if (strcmp(argv[i], "-d") == 0) depth = value;
+        else {
+            fprintf(stderr, "usage: %s [-f functions] [-g globals] [-l locals] [-a args] [-d depth]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    /* stay within the limits of cminus_parser.h */
+    if (globals > MAX_SYMS) globals = MAX_SYMS;
+    if (locals + args > MAX_SYMS) locals = MAX_SYMS - args;
+    if (args > MAX_ARGS) args = MAX_ARGS;
+    if (depth < 1) depth = 1;
+
+    for (size_t i = 0; i < globals; i++)
+        printf("int g%lu = %lu;\n", i, i);
+    printf("\n");
+
+    for (size_t f = 0; f < functions; f++) {
+        printf("void f%lu(", f);
+        for (size_t i = 0; i < args; i++)
+            printf(i ? ", int a%lu" : "int a%lu", i);
+        printf(") ");
+        write_scope(f, 0);
+        printf("\n");
+    }
+
+    printf("int main() {\n");
+    if (functions) {
+        printf("    f%lu(", functions - 1);
+        for (size_t i = 0; i < args; i++)
+            printf(i ? ", %lu" : "%lu", i);
+        printf(");\n");
+    }
+    printf("}\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+/* allocator churn: every leaf of a call tree allocates and frees mixed sizes, then fills and resets the arena
+   pointers are kept in long long so they fit with -m64 */
+
+void churn() {
+    long long a = sys_alloc(8);
+    long long b = sys_alloc(24);
+    long long c = sys_alloc(100);
+    long long d = sys_alloc(500);
+    sys_free(b);
+    sys_free(a);
+    long long e = sys_alloc(20);
+    sys_free(c);
+    sys_free(d);
+    sys_free(e);
+}
+
+void arena() {
+    sys_alloc(16);
+    sys_alloc(32);
+    sys_alloc(64);
+    sys_alloc(128);
+    sys_arena_reset();
+}
+
+void f0() {
+    churn();
+    arena();
+}
+
+void f1() {
+    f0();
+    f0();
+}
+
+void f2() {
+    f1();
+    f1();
+}
+
+void f3() {
+    f2();
+    f2();
+}
+
+void f4() {
+    f3();
+    f3();
+}
+
+void f5() {
+    f4();
+    f4();
+}
+
+void f6() {
+    f5();
+    f5();
+}
+
+void f7() {
+    f6();
+    f6();
+}
+
+void f8() {
+    f7();
+    f7();
+}
+
+void f9() {
+    f8();
+    f8();
+}
+
+void f10() {
+    f9();
+    f9();
+}
+
+void f11() {
+    f10();
+    f10();
+}
+
+void f12() {
+    f11();
+    f11();
+}
+
+void f13() {
+    f12();
+    f12();
+}
+
+void f14() {
+    f13();
+    f13();
+}
+
+int main() {
+    f14();
+}
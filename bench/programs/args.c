@@ -0,0 +1,185 @@
+/* argument passing with 1 to 20 args */
+
+int g = 7;
+
+void take1(int a0) {
+    g = a0;
+}
+
+void take2(int a0, int a1) {
+    g = a1;
+}
+
+void take3(int a0, int a1, int a2) {
+    g = a2;
+}
+
+void take4(int a0, int a1, int a2, int a3) {
+    g = a3;
+}
+
+void take5(int a0, int a1, int a2, int a3, int a4) {
+    g = a4;
+}
+
+void take6(int a0, int a1, int a2, int a3, int a4, int a5) {
+    g = a5;
+}
+
+void take7(int a0, int a1, int a2, int a3, int a4, int a5, int a6) {
+    g = a6;
+}
+
+void take8(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7) {
+    g = a7;
+}
+
+void take9(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8) {
+    g = a8;
+}
+
+void take10(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8, int a9) {
+    g = a9;
+}
+
+void take11(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8, int a9, int a10) {
+    g = a10;
+}
+
+void take12(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8, int a9, int a10, int a11) {
+    g = a11;
+}
+
+void take13(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8, int a9, int a10, int a11, int a12) {
+    g = a12;
+}
+
+void take14(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8, int a9, int a10, int a11, int a12, int a13) {
+    g = a13;
+}
+
+void take15(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8, int a9, int a10, int a11, int a12, int a13, int a14) {
+    g = a14;
+}
+
+void take16(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8, int a9, int a10, int a11, int a12, int a13, int a14, int a15) {
+    g = a15;
+}
+
+void take17(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8, int a9, int a10, int a11, int a12, int a13, int a14, int a15, int a16) {
+    g = a16;
+}
+
+void take18(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8, int a9, int a10, int a11, int a12, int a13, int a14, int a15, int a16, int a17) {
+    g = a17;
+}
+
+void take19(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8, int a9, int a10, int a11, int a12, int a13, int a14, int a15, int a16, int a17, int a18) {
+    g = a18;
+}
+
+void take20(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8, int a9, int a10, int a11, int a12, int a13, int a14, int a15, int a16, int a17, int a18, int a19) {
+    g = a19;
+}
+
+void all() {
+    int l = g;
+    take1(l);
+    take2(l, g);
+    take3(l, g, 2);
+    take4(l, g, 2, l);
+    take5(l, g, 2, l, g);
+    take6(l, g, 2, l, g, 5);
+    take7(l, g, 2, l, g, 5, l);
+    take8(l, g, 2, l, g, 5, l, g);
+    take9(l, g, 2, l, g, 5, l, g, 8);
+    take10(l, g, 2, l, g, 5, l, g, 8, l);
+    take11(l, g, 2, l, g, 5, l, g, 8, l, g);
+    take12(l, g, 2, l, g, 5, l, g, 8, l, g, 11);
+    take13(l, g, 2, l, g, 5, l, g, 8, l, g, 11, l);
+    take14(l, g, 2, l, g, 5, l, g, 8, l, g, 11, l, g);
+    take15(l, g, 2, l, g, 5, l, g, 8, l, g, 11, l, g, 14);
+    take16(l, g, 2, l, g, 5, l, g, 8, l, g, 11, l, g, 14, l);
+    take17(l, g, 2, l, g, 5, l, g, 8, l, g, 11, l, g, 14, l, g);
+    take18(l, g, 2, l, g, 5, l, g, 8, l, g, 11, l, g, 14, l, g, 17);
+    take19(l, g, 2, l, g, 5, l, g, 8, l, g, 11, l, g, 14, l, g, 17, l);
+    take20(l, g, 2, l, g, 5, l, g, 8, l, g, 11, l, g, 14, l, g, 17, l, g);
+}
+
+void a0() {
+    all();
+}
+
+void a1() {
+    a0();
+    a0();
+}
+
+void a2() {
+    a1();
+    a1();
+}
+
+void a3() {
+    a2();
+    a2();
+}
+
+void a4() {
+    a3();
+    a3();
+}
+
+void a5() {
+    a4();
+    a4();
+}
+
+void a6() {
+    a5();
+    a5();
+}
+
+void a7() {
+    a6();
+    a6();
+}
+
+void a8() {
+    a7();
+    a7();
+}
+
+void a9() {
+    a8();
+    a8();
+}
+
+void a10() {
+    a9();
+    a9();
+}
+
+void a11() {
+    a10();
+    a10();
+}
+
+void a12() {
+    a11();
+    a11();
+}
+
+void a13() {
+    a12();
+    a12();
+}
+
+void a14() {
+    a13();
+    a13();
+}
+
+int main() {
+    a14();
+}
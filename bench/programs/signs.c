@@ -0,0 +1,58 @@
+/* sign and zero extension of narrow variables, the exit code is 0 when every value matches (memcmp of the results) */
+
+struct results {
+    int global_char;
+    int global_uchar;
+    int global_short;
+    int local_char;
+    int local_init;
+    int global_charlit;
+    int local_charlit;
+    int param_char;
+    int param_ushort;
+};
+
+char gc = 200;
+unsigned char guc = 200;
+short gs = 40000;
+char gl = 'c';
+int pc;
+int ps;
+
+void params(char c, unsigned short s) {
+    pc = c;
+    ps = s;
+}
+
+int main() {
+    struct results got;
+    struct results want;
+    got.global_char = gc;
+    got.global_uchar = guc;
+    got.global_short = gs;
+    unsigned char uc = 200;
+    char c = 0;
+    c = uc;
+    got.local_char = c;
+    char d = uc;
+    int y = d;
+    got.local_init = y;
+    got.global_charlit = gl;
+    char l = 'x';
+    got.local_charlit = l;
+    params(200, 70000);
+    got.param_char = pc;
+    got.param_ushort = ps;
+
+    want.global_char = 4294967240;
+    want.global_uchar = 200;
+    want.global_short = 4294941760;
+    want.local_char = 4294967240;
+    want.local_init = 4294967240;
+    want.global_charlit = 99;
+    want.local_charlit = 120;
+    want.param_char = 4294967240;
+    want.param_ushort = 4464;
+    int r = __builtin_memcmp(&got, &want, 36);
+    sys_exit(r);
+}
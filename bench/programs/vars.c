@@ -0,0 +1,141 @@
+/* global and local variable churn under a call tree */
+
+int g0 = 0;
+int g1 = 1;
+int g2 = 2;
+int g3 = 3;
+int g4 = 4;
+int g5 = 5;
+int g6 = 6;
+int g7 = 7;
+
+void churn() {
+    int l0 = g0;
+    int l1 = g1;
+    int l2 = g2;
+    int l3 = g3;
+    int l4 = g4;
+    int l5 = g5;
+    int l6 = g6;
+    int l7 = g7;
+    g1 = l0;
+    g2 = l1;
+    g3 = l2;
+    g4 = l3;
+    g5 = l4;
+    g6 = l5;
+    g7 = l6;
+    g0 = l7;
+    l0 = g3;
+    l1 = g4;
+    l2 = g5;
+    l3 = g6;
+    l4 = g7;
+    l5 = g0;
+    l6 = g1;
+    l7 = g2;
+    char c = l0;
+    short s = l1;
+    long long w = l2;
+    g0 = c;
+    g1 = s;
+    g2 = w;
+}
+
+void v0() {
+    churn();
+}
+
+void v1() {
+    v0();
+    v0();
+}
+
+void v2() {
+    v1();
+    v1();
+}
+
+void v3() {
+    v2();
+    v2();
+}
+
+void v4() {
+    v3();
+    v3();
+}
+
+void v5() {
+    v4();
+    v4();
+}
+
+void v6() {
+    v5();
+    v5();
+}
+
+void v7() {
+    v6();
+    v6();
+}
+
+void v8() {
+    v7();
+    v7();
+}
+
+void v9() {
+    v8();
+    v8();
+}
+
+void v10() {
+    v9();
+    v9();
+}
+
+void v11() {
+    v10();
+    v10();
+}
+
+void v12() {
+    v11();
+    v11();
+}
+
+void v13() {
+    v12();
+    v12();
+}
+
+void v14() {
+    v13();
+    v13();
+}
+
+void v15() {
+    v14();
+    v14();
+}
+
+void v16() {
+    v15();
+    v15();
+}
+
+void v17() {
+    v16();
+    v16();
+}
+
+void v18() {
+    v17();
+    v17();
+}
+
+int main() {
+    v18();
+}
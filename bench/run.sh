@@ -0,0 +1,43 @@
+#!/bin/sh
+# runtime benchmarks: builds every program in bench/programs with cminus and times the binary
+# usage: bench/run.sh [cminus flags], one JSON line per program is appended to bench_output.txt
+# instructions retired are read with perf when it is installed
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+RESULTS="$ROOT/bench_output.txt"
+RUNS=5
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+for program in "$ROOT"/bench/programs/*.c; do
+    name=$(basename "$program" .c)
+    cp "$program" "$WORK/$name.c"
+
+    if ! (cd "$WORK" && "$ROOT/cminus" -fno-cache "$@" "$name.c" > /dev/null) || [ ! -x "$WORK/a.out" ]; then
+        echo "$name: build failed" >&2
+        continue
+    fi
+
+    # best of n wall time
+    best=
+    for run in $(seq $RUNS); do
+        start=$(date +%s%N)
+        "$WORK/a.out"
+        end=$(date +%s%N)
+        elapsed=$(( (end - start) / 1000 ))
+        if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then best=$elapsed; fi
+    done
+
+    instructions=null
+    if command -v perf > /dev/null 2>&1; then
+        count=$(perf stat -x, -e instructions:u "$WORK/a.out" 2>&1 > /dev/null | cut -d, -f1)
+        case "$count" in ''|*[!0-9]*) ;; *) instructions=$count ;; esac
+    fi
+
+    size=$(wc -c < "$WORK/a.out")
+    printf '%-8s %10s us %14s instructions %8s bytes\n' "$name" "$best" "$instructions" "$size"
+    printf '{"name": "run_%s", "flags": "%s", "wall_us": %s, "instructions": %s, "binary_bytes": %s}\n' \
+        "$name" "$*" "$best" "$instructions" "$size" >> "$RESULTS"
+
+    rm -f "$WORK/a.out" "$WORK/$name.o"
+done
@@ -0,0 +1,957 @@
+/*
+    cminus_emu.h - runs the assembly cminus emits, one instruction at a time
+
+    only the subset of nasm cminus writes is understood (i386, or x86-64 after `bits 64`)
+    every instruction, memory load and store is counted per function, so codegen changes can be
+    measured exactly, without wall clocks or hardware counters
+
+    #define CMINUS_EMU_IMPLEMENTATION in one file before including this
+*/
+
+#ifndef CMINUS_EMU_H
+#define CMINUS_EMU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#ifndef CMINUS_ENUM
+#define CMINUS_ENUM(type, name) type name; enum
+#endif
+
+#define CMINUS_EMU_MEMORY 0x4000000 /* 64MB of emulated memory, data at the bottom and the stack at the top */
+#define CMINUS_EMU_MAX_FUNCS 4096
+
+typedef struct cminus_emu_func {
+    char name[256];
+    uint64_t calls;
+    uint64_t instructions, loads, stores; /* self, not including callees */
+    uint64_t max_stack; /* deepest the stack got below the return address, in bytes */
+} cminus_emu_func;
+
+typedef struct cminus_emu_stats {
+    uint64_t instructions, loads, stores;
+    uint64_t syscalls, data_stores; /* stores to .data and .bss */
+    int exit_code;
+    uint64_t exit_value; /* the whole exit argument, exit_code is its low byte */
+    bool exited; /* false when the program faulted or ran out of steps */
+    const char* error;
+
+    cminus_emu_func funcs[CMINUS_EMU_MAX_FUNCS];
+    size_t func_count;
+} cminus_emu_stats;
+
+/* run a program from its assembly, max_steps bounds the instructions executed (0 for no limit) */
+inline bool cminus_emu_run(char* text, size_t len, uint64_t max_steps, cminus_emu_stats* stats);
+/* like cminus_emu_run, but any syscall other than exit stops the program before it reaches the host */
+inline bool cminus_emu_eval(char* text, size_t len, uint64_t max_steps, cminus_emu_stats* stats);
+inline void cminus_emu_report(cminus_emu_stats* stats, FILE* out);
+
+#endif
+
+#ifdef CMINUS_EMU_IMPLEMENTATION
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+
+#define CMINUS_EMU_CODE_BASE 0x40000000 /* code has no memory, its addresses are instruction indices */
+#define CMINUS_EMU_DATA_BASE 0x1000
+#define CMINUS_EMU_NONE 0xFF
+
+typedef CMINUS_ENUM(uint8_t, cminus_emu_kind) {
+    cminus_emu_none = 0,
+    cminus_emu_reg,
+    cminus_emu_imm,
+    cminus_emu_mem,
+};
+
+typedef struct cminus_emu_operand {
+    cminus_emu_kind kind;
+    uint8_t size; /* in bytes, 0 if the other operand decides */
+    uint8_t reg; /* register, or the base of a memory operand */
+    uint8_t index, scale;
+    bool high; /* ah, ch, dh or bh */
+    int64_t imm; /* immediate, or the displacement of a memory operand */
+} cminus_emu_operand;
+
+/* instructions are grouped by how they execute, the mnemonic tells the members apart */
+typedef CMINUS_ENUM(uint8_t, cminus_emu_group) {
+    cminus_emu_unknown = 0,
+    cminus_emu_mov, cminus_emu_movx, cminus_emu_lea,
+    cminus_emu_arith, cminus_emu_logic, cminus_emu_unary, cminus_emu_imul, cminus_emu_div, cminus_emu_shift,
+    cminus_emu_cdq, cminus_emu_cqo, cminus_emu_push, cminus_emu_pop,
+    cminus_emu_call, cminus_emu_ret, cminus_emu_jmp, cminus_emu_jcc, cminus_emu_setcc, cminus_emu_string,
+    cminus_emu_sys, cminus_emu_nop,
+};
+
+typedef struct cminus_emu_inst {
+    cminus_emu_group group;
+    char op[16];
+    bool rep; /* rep, or repe for cmps */
+    cminus_emu_operand args[2];
+    size_t func; /* function the instruction belongs to */
+} cminus_emu_inst;
+
+typedef struct cminus_emu_label {
+    char name[256];
+    uint64_t addr;
+} cminus_emu_label;
+
+typedef struct cminus_emu {
+    bool m64;
+    uint8_t* memory;
+    uint64_t regs[16];
+    bool zf, sf, cf, of;
+    uint64_t heap; /* next free byte for mmap */
+    uint64_t data_end;
+
+    cminus_emu_inst* code;
+    size_t code_len, code_cap;
+    cminus_emu_label* labels;
+    size_t label_count, label_cap;
+    char scope[256]; /* last non-local label, local labels (.name) belong to it like in nasm */
+
+    cminus_emu_stats* stats;
+    const char* error;
+    bool sandbox; /* only exit is allowed, for compile time evaluation */
+} cminus_emu;
+
+/* x86 register numbering */
+const char* cminus_emu_regs[4][16] = {
+    {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"},
+    {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"},
+    {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+    {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"},
+};
+
+#define CMINUS_EMU_SP 4
+
+bool cminus_emu_find_reg(const char* name, uint8_t* reg, uint8_t* size, bool* high) {
+    const char* highs[] = {"ah", "ch", "dh", "bh"};
+    for (uint8_t i = 0; i < 4; i++) {
+        if (strcmp(name, highs[i]) == 0) {
+            *reg = i; *size = 1; *high = true;
+            return true;
+        }
+    }
+
+    for (uint8_t s = 0; s < 4; s++) {
+        for (uint8_t i = 0; i < 16; i++) {
+            if (strcmp(name, cminus_emu_regs[s][i]) == 0) {
+                *reg = i; *size = 1 << s; *high = false;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+cminus_emu_label* cminus_emu_find_label(cminus_emu* emu, const char* name) {
+    char full[512];
+    if (name[0] == '.') {
+        snprintf(full, sizeof(full), "%s%s", emu->scope, name);
+        name = full;
+    }
+
+    for (size_t i = 0; i < emu->label_count; i++)
+        if (strcmp(emu->labels[i].name, name) == 0)
+            return &emu->labels[i];
+    return NULL;
+}
+
+void cminus_emu_add_label(cminus_emu* emu, const char* name, uint64_t addr) {
+    if (emu->label_count == emu->label_cap) {
+        emu->label_cap = emu->label_cap ? emu->label_cap * 2 : 256;
+        emu->labels = realloc(emu->labels, emu->label_cap * sizeof(cminus_emu_label));
+    }
+
+    if (name[0] == '.')
+        snprintf(emu->labels[emu->label_count].name, sizeof(emu->labels[0].name), "%s%s", emu->scope, name);
+    else
+        snprintf(emu->labels[emu->label_count].name, sizeof(emu->labels[0].name), "%s", name);
+    emu->labels[emu->label_count].addr = addr;
+    emu->label_count++;
+}
+
+/* number or label, labels resolve to 0 until they are known */
+bool cminus_emu_value(cminus_emu* emu, const char* str, int64_t* out) {
+    char* end;
+    if (isdigit((unsigned char)str[0]) || str[0] == '-') {
+        *out = strtoll(str, &end, 0);
+        return *end == '\0';
+    }
+
+    if (str[0] == '\'' && str[1] && str[2] == '\'') {
+        *out = (uint8_t)str[1];
+        return true;
+    }
+
+    cminus_emu_label* label = cminus_emu_find_label(emu, str);
+    *out = label ? (int64_t)label->addr : 0;
+    return label != NULL || emu->code == NULL;
+}
+
+char* cminus_emu_trim(char* str) {
+    while (isspace((unsigned char)*str)) str++;
+    char* end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return str;
+}
+
+/* parse "eax", "5", "label", "byte [esp + 4]" or "[a + ecx*4 - 8]" */
+bool cminus_emu_operand_parse(cminus_emu* emu, char* str, cminus_emu_operand* op) {
+    memset(op, 0, sizeof(*op));
+    op->reg = op->index = CMINUS_EMU_NONE;
+    str = cminus_emu_trim(str);
+
+    const char* sizes[] = {"byte", "word", "dword", "qword"};
+    for (uint8_t s = 0; s < 4; s++) {
+        size_t len = strlen(sizes[s]);
+        if (strncmp(str, sizes[s], len) == 0 && isspace((unsigned char)str[len])) {
+            op->size = 1 << s;
+            str = cminus_emu_trim(str + len);
+            break;
+        }
+    }
+
+    if (str[0] != '[') {
+        bool high;
+        if (cminus_emu_find_reg(str, &op->reg, &op->size, &high)) {
+            op->kind = cminus_emu_reg;
+            op->high = high;
+            return true;
+        }
+
+        op->kind = cminus_emu_imm;
+        return cminus_emu_value(emu, str, &op->imm);
+    }
+
+    /* memory: terms joined by + or - */
+    op->kind = cminus_emu_mem;
+    char* end = strchr(str, ']');
+    if (end == NULL) return false;
+    *end = '\0';
+
+    char* term = str + 1;
+    int sign = 1;
+    for (;;) {
+        char* next = term;
+        while (*next && *next != '+' && *next != '-') next++;
+
+        char saved = *next;
+        *next = '\0';
+        char* name = cminus_emu_trim(term);
+        if (strncmp(name, "rel ", 4) == 0) name = cminus_emu_trim(name + 4);
+
+        char* star = strchr(name, '*');
+        uint8_t reg, size;
+        bool high;
+        if (*name == '\0') {
+        } else if (star) {
+            *star = '\0';
+            if (!cminus_emu_find_reg(cminus_emu_trim(name), &reg, &size, &high)) return false;
+            op->index = reg;
+            op->scale = (uint8_t)strtol(star + 1, NULL, 10);
+        } else if (cminus_emu_find_reg(name, &reg, &size, &high)) {
+            if (op->reg == CMINUS_EMU_NONE) op->reg = reg;
+            else { op->index = reg; op->scale = 1; }
+        } else {
+            int64_t val;
+            if (!cminus_emu_value(emu, name, &val)) return false;
+            op->imm += sign * val;
+        }
+
+        if (saved == '\0')
+            break;
+        sign = (saved == '-') ? -1 : 1;
+        term = next + 1;
+    }
+
+    return true;
+}
+
+/* split the operands of a line at top level commas */
+size_t cminus_emu_split(char* str, char** parts, size_t max) {
+    size_t count = 0;
+    bool quote = false;
+    int depth = 0;
+
+    if (*cminus_emu_trim(str) == '\0') return 0;
+    parts[count++] = str;
+    for (char* c = str; *c; c++) {
+        if (*c == '"' || *c == '\'') quote = !quote;
+        else if (!quote && *c == '[') depth++;
+        else if (!quote && *c == ']') depth--;
+        else if (!quote && depth == 0 && *c == ',' && count < max) {
+            *c = '\0';
+            parts[count++] = c + 1;
+        }
+    }
+
+    return count;
+}
+
+/* size of a data directive in bytes, 0 if it isn't one */
+size_t cminus_emu_data_size(const char* op, bool* reserve) {
+    const char* defines[] = {"db", "dw", "dd", "dq"};
+    const char* reserves[] = {"resb", "resw", "resd", "resq"};
+    for (size_t i = 0; i < 4; i++) {
+        if (strcmp(op, defines[i]) == 0) { *reserve = false; return 1 << i; }
+        if (strcmp(op, reserves[i]) == 0) { *reserve = true; return 1 << i; }
+    }
+
+    return 0;
+}
+
+/* lay out (or on the second pass, fill in) a data directive, returns its size */
+uint64_t cminus_emu_data(cminus_emu* emu, char* op, char* args, uint64_t addr, bool fill) {
+    size_t times = 1;
+    if (strcmp(op, "times") == 0) {
+        char* rest = args;
+        while (*rest && !isspace((unsigned char)*rest)) rest++;
+        if (*rest) *rest++ = '\0';
+        int64_t count = 0;
+        cminus_emu_value(emu, cminus_emu_trim(args), &count);
+        times = (size_t)count;
+
+        rest = cminus_emu_trim(rest);
+        op = rest;
+        while (*rest && !isspace((unsigned char)*rest)) rest++;
+        if (*rest) *rest++ = '\0';
+        args = rest;
+    }
+
+    bool reserve;
+    size_t size = cminus_emu_data_size(op, &reserve);
+    if (size == 0)
+        return 0;
+
+    if (reserve) {
+        int64_t count = 0;
+        cminus_emu_value(emu, cminus_emu_trim(args), &count);
+        return size * count * times;
+    }
+
+    uint64_t start = addr;
+    for (size_t t = 0; t < times; t++) {
+        char copy[0x1000];
+        snprintf(copy, sizeof(copy), "%s", args);
+        char* parts[256];
+        size_t count = cminus_emu_split(copy, parts, 256);
+        for (size_t i = 0; i < count; i++) {
+            char* part = cminus_emu_trim(parts[i]);
+            if (part[0] == '"' || (part[0] == '\'' && strlen(part) != 3)) {
+                char quote = part[0];
+                for (char* c = part + 1; *c && *c != quote; c++) {
+                    if (fill && addr < CMINUS_EMU_MEMORY) emu->memory[addr] = (uint8_t)*c;
+                    addr++;
+                }
+                continue;
+            }
+
+            int64_t val = 0;
+            cminus_emu_value(emu, part, &val);
+            if (fill && addr + size <= CMINUS_EMU_MEMORY)
+                memcpy(&emu->memory[addr], &val, size);
+            addr += size;
+        }
+    }
+
+    return addr - start;
+}
+
+cminus_emu_group cminus_emu_decode(const char* op) {
+    const struct { const char* op; cminus_emu_group group; } ops[] = {
+        {"mov", cminus_emu_mov}, {"movsx", cminus_emu_movx}, {"movsxd", cminus_emu_movx}, {"movzx", cminus_emu_movx},
+        {"lea", cminus_emu_lea}, {"add", cminus_emu_arith}, {"sub", cminus_emu_arith}, {"cmp", cminus_emu_arith},
+        {"and", cminus_emu_logic}, {"or", cminus_emu_logic}, {"xor", cminus_emu_logic}, {"test", cminus_emu_logic},
+        {"inc", cminus_emu_unary}, {"dec", cminus_emu_unary}, {"neg", cminus_emu_unary}, {"not", cminus_emu_unary},
+        {"imul", cminus_emu_imul}, {"div", cminus_emu_div}, {"shl", cminus_emu_shift}, {"shr", cminus_emu_shift}, {"sar", cminus_emu_shift},
+        {"cdq", cminus_emu_cdq}, {"cqo", cminus_emu_cqo}, {"push", cminus_emu_push}, {"pop", cminus_emu_pop},
+        {"call", cminus_emu_call}, {"ret", cminus_emu_ret}, {"jmp", cminus_emu_jmp},
+        {"int", cminus_emu_sys}, {"syscall", cminus_emu_sys}, {"nop", cminus_emu_nop},
+        {"movsb", cminus_emu_string}, {"movsw", cminus_emu_string}, {"movsd", cminus_emu_string}, {"movsq", cminus_emu_string},
+        {"stosb", cminus_emu_string}, {"stosw", cminus_emu_string}, {"stosd", cminus_emu_string}, {"stosq", cminus_emu_string},
+        {"cmpsb", cminus_emu_string},
+    };
+
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+        if (strcmp(op, ops[i].op) == 0)
+            return ops[i].group;
+    
+    if (strncmp(op, "set", 3) == 0) return cminus_emu_setcc;
+    return op[0] == 'j' ? cminus_emu_jcc : cminus_emu_unknown;
+}
+
+/*
+    two passes over the source: the first finds labels and lays out data,
+    the second decodes instructions and fills in data now that every label is known
+*/
+bool cminus_emu_load(cminus_emu* emu, char* text, size_t len) {
+    for (int pass = 0; pass < 2; pass++) {
+        bool in_text = true;
+        uint64_t data = CMINUS_EMU_DATA_BASE;
+        size_t code = 0, func = 0;
+        emu->m64 = false;
+        emu->scope[0] = '\0';
+
+        char* line = text;
+        while (line < text + len) {
+            char* eol = memchr(line, '\n', text + len - line);
+            if (eol == NULL) eol = text + len;
+
+            char buffer[0x1000];
+            size_t size = (size_t)(eol - line) < sizeof(buffer) - 1 ? (size_t)(eol - line) : sizeof(buffer) - 1;
+            memcpy(buffer, line, size);
+            buffer[size] = '\0';
+            line = eol + 1;
+
+            /* drop comments */
+            bool quote = false;
+            for (char* c = buffer; *c; c++) {
+                if (*c == '"') quote = !quote;
+                if (*c == ';' && !quote) { *c = '\0'; break; }
+            }
+
+            char* str = cminus_emu_trim(buffer);
+            if (str[0] == '\0' || str[0] == '%')
+                continue;
+
+            /* labels */
+            char* colon = strchr(str, ':');
+            char* space = str;
+            while (*space && !isspace((unsigned char)*space)) space++;
+            if (colon && colon < space) {
+                *colon = '\0';
+                if (str[0] != '.')
+                    snprintf(emu->scope, sizeof(emu->scope), "%s", str);
+                if (pass == 0) {
+                    if (in_text) cminus_emu_add_label(emu, str, CMINUS_EMU_CODE_BASE + code);
+                    else cminus_emu_add_label(emu, str, data);
+                }
+
+                if (in_text && str[0] != '.') {
+                    func = 0;
+                    for (size_t i = 0; i < emu->stats->func_count; i++)
+                        if (strcmp(emu->stats->funcs[i].name, str) == 0) func = i;
+                }
+
+                str = cminus_emu_trim(colon + 1);
+                if (str[0] == '\0')
+                    continue;
+            }
+
+            char* op = str;
+            char* args = str;
+            while (*args && !isspace((unsigned char)*args)) args++;
+            if (*args) *args++ = '\0';
+            args = cminus_emu_trim(args);
+
+            if (strcmp(op, "section") == 0 || strcmp(op, "segment") == 0) {
+                in_text = strcmp(args, ".text") == 0 || strncmp(args, ".text.", 6) == 0;
+                continue;
+            }
+            if (strcmp(op, "bits") == 0) { emu->m64 = strcmp(args, "64") == 0; continue; }
+            if (strcmp(op, "global") == 0 || strcmp(op, "extern") == 0 || strcmp(op, "default") == 0) continue;
+            /* name equ value, the value is a sum of labels and numbers */
+            if (strncmp(args, "equ", 3) == 0 && isspace((unsigned char)args[3])) {
+                if (pass == 0) {
+                    char expr[0x1000];
+                    cminus_emu_operand value;
+                    snprintf(expr, sizeof(expr), "[%s]", cminus_emu_trim(args + 3));
+                    cminus_emu_operand_parse(emu, expr, &value);
+                    cminus_emu_add_label(emu, op, (uint64_t)value.imm);
+                }
+                continue;
+            }
+            if (strcmp(op, "align") == 0 || strcmp(op, "alignb") == 0) {
+                int64_t align = 1;
+                cminus_emu_value(emu, args, &align);
+                if (!in_text && align > 1) data = (data + align - 1) / align * align;
+                continue;
+            }
+
+            if (!in_text || strcmp(op, "times") == 0 || cminus_emu_data_size(op, &(bool){0})) {
+                data += cminus_emu_data(emu, op, args, data, pass == 1);
+                continue;
+            }
+
+            if (pass == 0) {
+                code++;
+                continue;
+            }
+
+            if (emu->code_len == emu->code_cap) {
+                emu->code_cap = emu->code_cap ? emu->code_cap * 2 : 1024;
+                emu->code = realloc(emu->code, emu->code_cap * sizeof(cminus_emu_inst));
+            }
+
+            cminus_emu_inst* inst = &emu->code[emu->code_len];
+            memset(inst, 0, sizeof(*inst));
+            inst->func = func;
+            if (strcmp(op, "rep") == 0 || strcmp(op, "repe") == 0 || strcmp(op, "repz") == 0) {
+                inst->rep = true;
+                op = args;
+                while (*args && !isspace((unsigned char)*args)) args++;
+                if (*args) *args++ = '\0';
+            }
+            snprintf(inst->op, sizeof(inst->op), "%s", op);
+            inst->group = cminus_emu_decode(op);
+
+            char* parts[2];
+            size_t count = cminus_emu_split(args, parts, 2);
+            for (size_t i = 0; i < count; i++) {
+                if (!cminus_emu_operand_parse(emu, parts[i], &inst->args[i])) {
+                    emu->error = "unknown operand";
+                    fprintf(stderr, "cminus_emu: unknown operand: %s\n", parts[i]);
+                    return false;
+                }
+            }
+
+            emu->code_len++;
+        }
+
+        emu->data_end = data;
+        if (pass == 1)
+            break;
+
+        /* every label in .text that isn't local is a function */
+        for (size_t i = 0; i < emu->label_count; i++) {
+            if (emu->labels[i].addr < CMINUS_EMU_CODE_BASE || strchr(emu->labels[i].name, '.'))
+                continue;
+            if (emu->stats->func_count == CMINUS_EMU_MAX_FUNCS)
+                break;
+            cminus_emu_func* func = &emu->stats->funcs[emu->stats->func_count++];
+            snprintf(func->name, sizeof(func->name), "%s", emu->labels[i].name);
+        }
+
+        /* the second pass sees emu->code != NULL, so missing labels become errors */
+        emu->code_cap = code ? code : 1;
+        emu->code = malloc(emu->code_cap * sizeof(cminus_emu_inst));
+    }
+
+    return true;
+}
+
+uint64_t cminus_emu_mask(uint8_t size) {
+    return size >= 8 ? ~0ULL : ((1ULL << (size * 8)) - 1);
+}
+
+int64_t cminus_emu_sign(uint64_t val, uint8_t size) {
+    if (size >= 8) return (int64_t)val;
+    uint64_t sign = 1ULL << (size * 8 - 1);
+    val &= cminus_emu_mask(size);
+    return (int64_t)((val ^ sign) - sign);
+}
+
+uint64_t cminus_emu_addr(cminus_emu* emu, cminus_emu_operand* op) {
+    uint64_t addr = (uint64_t)op->imm;
+    if (op->reg != CMINUS_EMU_NONE) addr += emu->regs[op->reg];
+    if (op->index != CMINUS_EMU_NONE) addr += emu->regs[op->index] * op->scale;
+    return emu->m64 ? addr : (uint32_t)addr;
+}
+
+uint64_t cminus_emu_load_mem(cminus_emu* emu, uint64_t addr, uint8_t size, cminus_emu_func* func) {
+    if (addr < CMINUS_EMU_DATA_BASE || addr + size > CMINUS_EMU_MEMORY) {
+        emu->error = "load outside of memory";
+        return 0;
+    }
+
+    uint64_t val = 0;
+    memcpy(&val, &emu->memory[addr], size);
+    emu->stats->loads++;
+    func->loads++;
+    return val;
+}
+
+void cminus_emu_store_mem(cminus_emu* emu, uint64_t addr, uint64_t val, uint8_t size, cminus_emu_func* func) {
+    if (addr < CMINUS_EMU_DATA_BASE || addr + size > CMINUS_EMU_MEMORY) {
+        emu->error = "store outside of memory";
+        return;
+    }
+
+    memcpy(&emu->memory[addr], &val, size);
+    if (addr < emu->data_end)
+        emu->stats->data_stores++;
+    emu->stats->stores++;
+    func->stores++;
+}
+
+uint64_t cminus_emu_get(cminus_emu* emu, cminus_emu_operand* op, uint8_t size, cminus_emu_func* func) {
+    switch (op->kind) {
+        case cminus_emu_reg:
+            if (op->high) return (emu->regs[op->reg] >> 8) & 0xFF;
+            return emu->regs[op->reg] & cminus_emu_mask(size);
+        case cminus_emu_imm: return (uint64_t)op->imm & cminus_emu_mask(size);
+        case cminus_emu_mem: return cminus_emu_load_mem(emu, cminus_emu_addr(emu, op), size, func);
+        default: return 0;
+    }
+}
+
+void cminus_emu_set(cminus_emu* emu, cminus_emu_operand* op, uint64_t val, uint8_t size, cminus_emu_func* func) {
+    if (op->kind == cminus_emu_mem) {
+        cminus_emu_store_mem(emu, cminus_emu_addr(emu, op), val, size, func);
+        return;
+    }
+
+    if (op->kind != cminus_emu_reg) {
+        emu->error = "write to an immediate";
+        return;
+    }
+
+    uint64_t* reg = &emu->regs[op->reg];
+    if (op->high) *reg = (*reg & ~0xFF00ULL) | ((val & 0xFF) << 8);
+    else if (size >= 4) *reg = val & cminus_emu_mask(size); /* 32bit writes clear the upper half */
+    else *reg = (*reg & ~cminus_emu_mask(size)) | (val & cminus_emu_mask(size));
+}
+
+/* size of an instruction from its operands */
+uint8_t cminus_emu_size(cminus_emu* emu, cminus_emu_inst* inst) {
+    if (inst->args[0].size) return inst->args[0].size;
+    if (inst->args[1].kind == cminus_emu_reg && inst->args[1].size) return inst->args[1].size;
+    if (inst->args[1].size) return inst->args[1].size;
+    return emu->m64 ? 8 : 4;
+}
+
+void cminus_emu_flags(cminus_emu* emu, uint64_t result, uint8_t size) {
+    result &= cminus_emu_mask(size);
+    emu->zf = result == 0;
+    emu->sf = cminus_emu_sign(result, size) < 0;
+}
+
+bool cminus_emu_cond(cminus_emu* emu, const char* cc) {
+    if (!strcmp(cc, "e") || !strcmp(cc, "z")) return emu->zf;
+    if (!strcmp(cc, "ne") || !strcmp(cc, "nz")) return !emu->zf;
+    if (!strcmp(cc, "l")) return emu->sf != emu->of;
+    if (!strcmp(cc, "ge")) return emu->sf == emu->of;
+    if (!strcmp(cc, "le")) return emu->zf || emu->sf != emu->of;
+    if (!strcmp(cc, "g")) return !emu->zf && emu->sf == emu->of;
+    if (!strcmp(cc, "b") || !strcmp(cc, "c")) return emu->cf;
+    if (!strcmp(cc, "ae") || !strcmp(cc, "nc")) return !emu->cf;
+    if (!strcmp(cc, "be")) return emu->cf || emu->zf;
+    if (!strcmp(cc, "a")) return !emu->cf && !emu->zf;
+    if (!strcmp(cc, "s")) return emu->sf;
+    if (!strcmp(cc, "ns")) return !emu->sf;
+    return false;
+}
+
+/* linux syscalls, i386 numbers are mapped to x86-64 ones */
+bool cminus_emu_syscall(cminus_emu* emu) {
+    uint64_t nr, a, b, c;
+    if (emu->m64) {
+        nr = emu->regs[0]; a = emu->regs[7]; b = emu->regs[6]; c = emu->regs[2];
+    } else {
+        const uint64_t i386[] = {[1] = 60, [4] = 1, [5] = 2, [6] = 3, [54] = 16, [91] = 11, [192] = 9, [252] = 60};
+        nr = emu->regs[0] < sizeof(i386) / sizeof(i386[0]) ? i386[emu->regs[0]] : 0xFFFF;
+        a = emu->regs[3]; b = emu->regs[1]; c = emu->regs[2];
+    }
+
+    if (emu->sandbox && nr != 60 && nr != 231) {
+        emu->error = "syscall while evaluating";
+        return false;
+    }
+
+    int64_t ret = -38; /* ENOSYS */
+    switch (nr) {
+        case 60: case 231: /* exit */
+            emu->stats->exit_code = (int)(a & 0xFF);
+            emu->stats->exit_value = emu->m64 ? a : (a & 0xFFFFFFFF);
+            emu->stats->exited = true;
+            return false;
+        case 1: /* write */
+            if (b + c > CMINUS_EMU_MEMORY) { ret = -14; break; }
+            ret = write((int)a, &emu->memory[b], c);
+            break;
+        case 2: /* open */
+            if (a >= CMINUS_EMU_MEMORY) { ret = -14; break; }
+            ret = open((char*)&emu->memory[a], (int)b, (int)c);
+            break;
+        case 3: ret = close((int)a); break; /* close */
+        case 16: ret = isatty((int)a) ? 0 : -25; break; /* ioctl, only TCGETS is asked */
+        case 9: { /* mmap, anonymous memory from the heap */
+            uint64_t size = (b + 0xFFF) & ~0xFFFULL;
+            if (emu->heap + size > CMINUS_EMU_MEMORY / 2) { ret = -12; break; }
+            ret = (int64_t)emu->heap;
+            memset(&emu->memory[emu->heap], 0, size);
+            emu->heap += size;
+            break;
+        }
+        case 11: ret = 0; break; /* munmap */
+        default: break;
+    }
+
+    emu->regs[0] = emu->m64 ? (uint64_t)ret : (uint32_t)ret;
+    return true;
+}
+
+bool cminus_emu_exec(char* text, size_t len, uint64_t max_steps, cminus_emu_stats* stats, bool sandbox) {
+    cminus_emu emu = {0};
+    emu.sandbox = sandbox;
+    memset(stats, 0, sizeof(*stats));
+    emu.stats = stats;
+    emu.memory = calloc(1, CMINUS_EMU_MEMORY);
+
+    if (!cminus_emu_load(&emu, text, len)) {
+        stats->error = emu.error;
+        free(emu.memory);
+        free(emu.code);
+        free(emu.labels);
+        return false;
+    }
+
+
+    emu.heap = (emu.data_end + 0xFFF) & ~0xFFFULL;
+    uint8_t word = emu.m64 ? 8 : 4;
+
+    /* call stack of functions, to attribute stack depth */
+    size_t frames_cap = 1024, frame_count = 0;
+    struct { size_t func; uint64_t sp; } *frames = malloc(frames_cap * sizeof(*frames));
+
+    cminus_emu_label* start = cminus_emu_find_label(&emu, "_start");
+    size_t pc = start ? start->addr - CMINUS_EMU_CODE_BASE : 0;
+    emu.regs[CMINUS_EMU_SP] = CMINUS_EMU_MEMORY - 64;
+
+    size_t entry = 0;
+    for (size_t i = 0; i < stats->func_count; i++)
+        if (start && strcmp(stats->funcs[i].name, "_start") == 0) entry = i;
+    frames[frame_count].func = entry;
+    frames[frame_count++].sp = emu.regs[CMINUS_EMU_SP];
+    if (stats->func_count) stats->funcs[entry].calls++;
+
+    cminus_emu_func scratch = {0};
+    bool running = true;
+    while (running && emu.error == NULL) {
+        if (pc >= emu.code_len) {
+            emu.error = "ran off the end of the code";
+            break;
+        }
+
+        if (max_steps && stats->instructions >= max_steps) {
+            emu.error = "step limit reached";
+            break;
+        }
+
+        cminus_emu_inst* inst = &emu.code[pc++];
+        cminus_emu_func* func = stats->func_count ? &stats->funcs[frames[frame_count - 1].func] : &scratch;
+        stats->instructions++;
+        func->instructions++;
+
+        cminus_emu_operand* dst = &inst->args[0];
+        cminus_emu_operand* src = &inst->args[1];
+        uint8_t size = cminus_emu_size(&emu, inst);
+        const char* op = inst->op;
+
+        switch (inst->group) {
+            case cminus_emu_mov:
+                cminus_emu_set(&emu, dst, cminus_emu_get(&emu, src, size, func), size, func);
+                break;
+            case cminus_emu_movx: {
+                uint8_t from = src->size ? src->size : 4;
+                uint64_t val = cminus_emu_get(&emu, src, from, func);
+                if (op[3] == 's') val = (uint64_t)cminus_emu_sign(val, from);
+                cminus_emu_set(&emu, dst, val, dst->size, func);
+                break;
+            }
+            case cminus_emu_lea:
+                cminus_emu_set(&emu, dst, cminus_emu_addr(&emu, src), dst->size, func);
+                break;
+            case cminus_emu_arith: { /* add, sub, cmp */
+                uint64_t a = cminus_emu_get(&emu, dst, size, func);
+                uint64_t b = cminus_emu_get(&emu, src, size, func);
+                uint64_t r = (op[0] == 'a') ? a + b : a - b;
+                uint64_t mask = cminus_emu_mask(size);
+                int64_t sa = cminus_emu_sign(a, size), sb = cminus_emu_sign(b, size), sr = cminus_emu_sign(r, size);
+                if (op[0] == 'a') {
+                    emu.cf = (r & mask) < (a & mask);
+                    emu.of = (sa >= 0) == (sb >= 0) && (sr >= 0) != (sa >= 0);
+                } else {
+                    emu.cf = (a & mask) < (b & mask);
+                    emu.of = (sa >= 0) != (sb >= 0) && (sr >= 0) != (sa >= 0);
+                }
+                cminus_emu_flags(&emu, r, size);
+                if (op[1] != 'm') cminus_emu_set(&emu, dst, r, size, func);
+                break;
+            }
+            case cminus_emu_logic: { /* and, or, xor, test */
+                uint64_t a = cminus_emu_get(&emu, dst, size, func);
+                uint64_t b = cminus_emu_get(&emu, src, size, func);
+                uint64_t r = (op[0] == 'o') ? a | b : (op[0] == 'x') ? a ^ b : a & b;
+                emu.cf = emu.of = false;
+                cminus_emu_flags(&emu, r, size);
+                if (op[0] != 't') cminus_emu_set(&emu, dst, r, size, func);
+                break;
+            }
+            case cminus_emu_unary: { /* inc, dec, neg, not */
+                uint64_t a = cminus_emu_get(&emu, dst, size, func);
+                uint64_t r = (op[0] == 'i') ? a + 1 : (op[0] == 'd') ? a - 1 : (op[1] == 'e') ? 0 - a : ~a;
+                if (op[1] != 'o') cminus_emu_flags(&emu, r, size);
+                cminus_emu_set(&emu, dst, r, size, func);
+                break;
+            }
+            case cminus_emu_imul: {
+                int64_t r = cminus_emu_sign(cminus_emu_get(&emu, dst, size, func), size) * cminus_emu_sign(cminus_emu_get(&emu, src, size, func), size);
+                cminus_emu_set(&emu, dst, (uint64_t)r, size, func);
+                break;
+            }
+            case cminus_emu_shift: { /* shl, shr, sar */
+                uint64_t a = cminus_emu_get(&emu, dst, size, func);
+                uint8_t count = cminus_emu_get(&emu, src, 1, func) & (size == 8 ? 63 : 31);
+                uint64_t r = (op[2] == 'l') ? a << count : (op[1] == 'h') ? (a & cminus_emu_mask(size)) >> count : (uint64_t)(cminus_emu_sign(a, size) >> count);
+                cminus_emu_flags(&emu, r, size);
+                cminus_emu_set(&emu, dst, r, size, func);
+                break;
+            }
+            case cminus_emu_cdq:
+                emu.regs[2] = (emu.regs[0] & 0x80000000) ? 0xFFFFFFFF : 0;
+                break;
+            case cminus_emu_div: { /* unsigned, edx:eax (rdx:rax) by the operand */
+                uint64_t by = cminus_emu_get(&emu, dst, size, func);
+                if (by == 0) {
+                    emu.error = "division by zero";
+                    break;
+                }
+
+                if (size == 8) {
+                    unsigned __int128 n = ((unsigned __int128)emu.regs[2] << 64) | emu.regs[0];
+                    emu.regs[0] = (uint64_t)(n / by);
+                    emu.regs[2] = (uint64_t)(n % by);
+                } else {
+                    uint64_t n = ((emu.regs[2] & 0xFFFFFFFF) << 32) | (emu.regs[0] & 0xFFFFFFFF);
+                    emu.regs[0] = (uint32_t)(n / by);
+                    emu.regs[2] = (uint32_t)(n % by);
+                }
+                break;
+            }
+            case cminus_emu_cqo:
+                emu.regs[2] = (emu.regs[0] & 0x8000000000000000ULL) ? ~0ULL : 0;
+                break;
+            case cminus_emu_push: {
+                uint64_t val = cminus_emu_get(&emu, dst, word, func);
+                emu.regs[CMINUS_EMU_SP] -= word;
+                cminus_emu_store_mem(&emu, emu.regs[CMINUS_EMU_SP], val, word, func);
+                break;
+            }
+            case cminus_emu_pop: {
+                uint64_t val = cminus_emu_load_mem(&emu, emu.regs[CMINUS_EMU_SP], word, func);
+                emu.regs[CMINUS_EMU_SP] += word;
+                cminus_emu_set(&emu, dst, val, word, func);
+                break;
+            }
+            case cminus_emu_call: {
+                uint64_t target = cminus_emu_get(&emu, dst, word, func);
+                emu.regs[CMINUS_EMU_SP] -= word;
+                cminus_emu_store_mem(&emu, emu.regs[CMINUS_EMU_SP], CMINUS_EMU_CODE_BASE + pc, word, func);
+
+                pc = target - CMINUS_EMU_CODE_BASE;
+                if (frame_count == frames_cap) {
+                    frames_cap *= 2;
+                    frames = realloc(frames, frames_cap * sizeof(*frames));
+                }
+
+                size_t callee = pc < emu.code_len ? emu.code[pc].func : 0;
+                frames[frame_count].func = callee;
+                frames[frame_count++].sp = emu.regs[CMINUS_EMU_SP];
+                if (stats->func_count) stats->funcs[callee].calls++;
+                break;
+            }
+            case cminus_emu_ret: {
+                uint64_t target = cminus_emu_load_mem(&emu, emu.regs[CMINUS_EMU_SP], word, func);
+                emu.regs[CMINUS_EMU_SP] += word;
+                pc = target - CMINUS_EMU_CODE_BASE;
+                if (frame_count > 1) frame_count--;
+                break;
+            }
+            case cminus_emu_jmp:
+                pc = cminus_emu_get(&emu, dst, word, func) - CMINUS_EMU_CODE_BASE;
+                break;
+            case cminus_emu_jcc:
+                if (cminus_emu_cond(&emu, op + 1))
+                    pc = cminus_emu_get(&emu, dst, word, func) - CMINUS_EMU_CODE_BASE;
+                break;
+            case cminus_emu_setcc:
+                cminus_emu_set(&emu, dst, cminus_emu_cond(&emu, op + 3), 1, func);
+                break;
+            case cminus_emu_string: { /* movs, stos and cmps from esi to edi, rep repeats them ecx times */
+                uint8_t width = (op[4] == 'b') ? 1 : (op[4] == 'w') ? 2 : (op[4] == 'd') ? 4 : 8;
+                uint64_t count = inst->rep ? emu.regs[1] & cminus_emu_mask(word) : 1;
+                for (; count && emu.error == NULL; count--) {
+                    uint64_t si = emu.regs[6] & cminus_emu_mask(word), di = emu.regs[7] & cminus_emu_mask(word);
+                    if (op[0] == 'm') {
+                        cminus_emu_store_mem(&emu, di, cminus_emu_load_mem(&emu, si, width, func), width, func);
+                    } else if (op[0] == 's') {
+                        cminus_emu_store_mem(&emu, di, emu.regs[0] & cminus_emu_mask(width), width, func);
+                    } else {
+                        uint64_t a = cminus_emu_load_mem(&emu, si, width, func), b = cminus_emu_load_mem(&emu, di, width, func);
+                        emu.cf = a < b;
+                        emu.of = false;
+                        cminus_emu_flags(&emu, a - b, width);
+                    }
+
+                    if (op[0] != 's') emu.regs[6] = si + width;
+                    emu.regs[7] = di + width;
+                    if (inst->rep) emu.regs[1] = (emu.regs[1] - 1) & cminus_emu_mask(word);
+                    if (op[0] == 'c' && !emu.zf) /* repe stops at the first difference */
+                        break;
+                }
+                break;
+            }
+            case cminus_emu_sys: /* int 0x80 or syscall */
+                stats->syscalls++;
+                if (!cminus_emu_syscall(&emu))
+                    running = false;
+                break;
+            case cminus_emu_nop:
+                break;
+            default:
+                emu.error = "unsupported instruction";
+                fprintf(stderr, "cminus_emu: unsupported instruction: %s\n", op);
+                break;
+        }
+
+        if (emu.error == NULL && stats->func_count) {
+            uint64_t depth = frames[frame_count - 1].sp - emu.regs[CMINUS_EMU_SP];
+            if (frames[frame_count - 1].sp >= emu.regs[CMINUS_EMU_SP] && depth > func->max_stack)
+                func->max_stack = depth;
+        }
+    }
+
+    stats->error = emu.error;
+    free(frames);
+    free(emu.memory);
+    free(emu.code);
+    free(emu.labels);
+    return stats->exited;
+}
+
+bool cminus_emu_run(char* text, size_t len, uint64_t max_steps, cminus_emu_stats* stats) {
+    return cminus_emu_exec(text, len, max_steps, stats, false);
+}
+
+bool cminus_emu_eval(char* text, size_t len, uint64_t max_steps, cminus_emu_stats* stats) {
+    return cminus_emu_exec(text, len, max_steps, stats, true);
+}
+
+void cminus_emu_report(cminus_emu_stats* stats, FILE* out) {
+    if (stats->exited)
+        fprintf(out, "exit code %i\n", stats->exit_code);
+    else
+        fprintf(out, "error: %s\n", stats->error ? stats->error : "did not exit");
+
+    fprintf(out, "%-24s %12s %14s %12s %12s %10s\n", "function", "calls", "instructions", "loads", "stores", "max stack");
+    for (size_t i = 0; i < stats->func_count; i++) {
+        cminus_emu_func* func = &stats->funcs[i];
+        if (func->calls == 0) continue;
+        fprintf(out, "%-24s %12llu %14llu %12llu %12llu %10llu\n", func->name, (unsigned long long)func->calls,
+                (unsigned long long)func->instructions, (unsigned long long)func->loads, (unsigned long long)func->stores, (unsigned long long)func->max_stack);
+    }
+
+    fprintf(out, "%-24s %12s %14llu %12llu %12llu\n", "total", "", (unsigned long long)stats->instructions,
+            (unsigned long long)stats->loads, (unsigned long long)stats->stores);
+}
+#endif
@@ -7,6 +7,8 @@
 #define CMINUS_ENUM(type, name) type name; enum
 #define CMINUS_BIT(x) 1L << x
 
+#include "cminus_emu.h"
+
 typedef CMINUS_ENUM(uint32_t, cminus_state_type) {
     cminus_no_state = 0,
     cminus_declare = CMINUS_BIT(0),
@@ -16,39 +18,165 @@ typedef CMINUS_ENUM(uint32_t, cminus_state_type) {
     cminus_var = CMINUS_BIT(4),
     cminus_static = CMINUS_BIT(5),
     cminus_set = CMINUS_BIT(6),
+    cminus_aggregate = CMINUS_BIT(7), /* after struct or union */
+};
+
+typedef CMINUS_ENUM(uint32_t, cminus_flags) {
+    cminus_m64 = CMINUS_BIT(0), /* emit x86-64 instead of i386 */
+    cminus_frame_pointer = CMINUS_BIT(1), /* keep ebp frames for debuggers and profilers */
+    cminus_profile_generate = CMINUS_BIT(2), /* count function entries and write them to cminus_prof.path on exit */
+    cminus_profile_use = CMINUS_BIT(3), /* place functions in hot and cold sections using cminus_prof */
+    cminus_sample = CMINUS_BIT(4), /* sample the instruction pointer on SIGPROF and write the samples to cminus.pg on exit */
+    cminus_debug = CMINUS_BIT(5), /* map instructions back to cminus_debug_file with %line and give functions a size */
+    cminus_reorder_fields = CMINUS_BIT(6), /* lay struct fields out by alignment, largest first, to minimize padding */
 };
 
+#define CMINUS_PG_SAMPLES 4096 /* size of the -pg ring buffer, a power of 2 */
+
+/* runtime functions, only emitted when the program calls them */
+typedef CMINUS_ENUM(uint32_t, cminus_runtime) {
+    cminus_rt_heap = CMINUS_BIT(0), /* sys_alloc, sys_free, sys_arena_reset */
+    cminus_rt_print = CMINUS_BIT(1), /* sys_print, sys_print_int, sys_print_char, sys_flush */
+};
+
+#define CMINUS_HEAP_CHUNK 0x100000 /* sys_alloc maps memory 1MB at a time */
+#define CMINUS_HEAP_CLASSES 8 /* 16 to 2048 byte blocks, bigger ones get their own mapping */
+#define CMINUS_OUT_BUFFER 4096 /* sys_print buffers this much output before writing it */
+#define CMINUS_CACHE_LINE 64
+#define CMINUS_EVAL_STEPS 10000000 /* instructions a call in a global initializer may run at compile time */
+#define CMINUS_UNROLL_MEM 32 /* largest constant size __builtin_memcpy and memset expand to moves, bigger ones use rep movs and stos */
+#define CMINUS_STRING_POOL 0x10000 /* bytes of string literals per file */
+#define MAX_STRINGS 1024
+
 #define MAX_STACK 1024
 #define MAX_SYM_NAME 255
 #define MAX_SYMS 1024
 #define MAX_ARGS 20
 
+/* storage of a variable: size in bytes (1, 2, 4 or 8) and how it is extended to a register */
+typedef struct cminus_type {
+    size_t size;
+    bool is_unsigned;
+    size_t record; /* 1 + the index of a struct or union in cminus_records, 0 for scalars */
+} cminus_type;
+
+#define MAX_RECORDS 128
+#define MAX_FIELDS 64
+
+typedef struct cminus_field {
+    char name[MAX_SYM_NAME];
+    cminus_type type;
+    size_t offset;
+} cminus_field;
+
+/* struct and union layouts, with C's natural alignment */
+typedef struct cminus_record {
+    char name[MAX_SYM_NAME];
+    bool is_union;
+    cminus_field fields[MAX_FIELDS];
+    size_t field_count;
+    size_t size, align;
+} cminus_record;
+
+typedef struct cminus_sym {
+    char sym[MAX_SYM_NAME];
+    size_t scope, index;
+    cminus_type type;
+    size_t offset; /* of a member within the variable */
+} cminus_sym;
+
+#define CMINUS_AX_SYMS 8
+
+/* 
+    registers and calling convention of the target
+    generated code only uses the accumulator and the arg registers, which are all caller-saved,
+    so nothing is saved around calls and functions never save registers in their prologue
+    (ebx, esi, edi and ebp / rbx, rbp and r12-r15 are callee-saved and left untouched)
+*/
+typedef struct cminus_target {
+    size_t word; /* size of a stack slot */
+    const char* ax; /* accumulator */
+    const char* sp;
+    const char* bp;
+    const char* args[6]; /* registers used to pass the first args, the rest are pushed */
+    size_t arg_count;
+    const char* cx, *dx, *si, *di; /* scratch and string instruction registers, esi and edi are callee-saved on i386 */
+} cminus_target;
+
 typedef struct cminus_state {
     cminus_state_type type;
+    cminus_flags flags;
+    const cminus_target* target;
     stb_lexer *lexer;
     FILE* asm_file;
     size_t asm_index;
+    const char* section; /* section currently being written */
     size_t scope;
     size_t stack_len[MAX_STACK];
+    size_t depth; /* stack slots pushed since the function entry, locals are addressed from the stack pointer */
+    size_t data_len, bss_len; /* bytes of globals in .data and .bss, to align them */
 
-    char sym[MAX_ARGS][MAX_SYM_NAME]; /* name of the current sym */
+    char sym[MAX_ARGS + 1][MAX_SYM_NAME]; /* name of the current sym, followed by the args of a function */
+    cminus_type sym_types[MAX_ARGS + 1]; /* declared types of the args while a function is defined */
     size_t sym_count;
+    char callee[MAX_SYM_NAME]; /* function called in an initializer or assignment, eg. int p = sys_alloc(16); */
+    char rvalue[MAX_SYM_NAME]; /* last identifier, with its members, eg. "p.x" */
+    bool member; /* after '.', the next identifier is a member */
+    bool address; /* after '&' in a call, the next arg is the address of a variable */
+    cminus_sym ax_syms[CMINUS_AX_SYMS]; /* variables eax holds the value of, forgotten when a line changes eax */
+    size_t ax_count;
+    bool folded; /* the global initializer was a call, evaluated to folded_value */
+    int64_t folded_value;
+    char record_name[MAX_SYM_NAME]; /* name after struct or union */
+    bool record_union;
+    size_t defining; /* 1 + the index of the record whose body is being parsed */
+    size_t defined; /* 1 + the index of the record whose body just ended, for struct { ... } v; */
+    cminus_runtime runtime; /* runtime functions that were called */
+    cminus_type var_type; /* type of the variable being declared */
 
     stb_lexer prev;
     stb_lexer next;
+
+    /* source line of the current token, counted as the lexer moves forward */
+    size_t line, line_emitted;
+    char* line_pos;
 } cminus_state;
 
-inline void cminus_parse(char* file, size_t file_len, char* string_buffer, size_t string_len, FILE* asm_file);
+/* counters and timers for --stats, times are only taken while enabled */
+typedef struct cminus_stats {
+    bool enabled;
+    double lex_ms, parse_ms, sym_ms, emit_ms; /* parse_ms excludes the others */
+    size_t tokens, relexed; /* relexed counts the lookahead */
+    size_t find_sym_calls, find_sym_probes, find_sym_max_probes;
+    size_t lines, bytes;
+    size_t loads_removed; /* loads of a variable eax already held */
+} cminus_stats;
+
+extern cminus_stats cminus_stat;
+
+/* 
+    function entry counts, -fprofile-generate writes them as records of a 32bit count followed by the function's name
+    -fprofile-use loads them back with cminus_profile_load
+*/
+typedef struct cminus_profile {
+    const char* path;
+    char names[MAX_SYMS][MAX_SYM_NAME];
+    uint32_t counts[MAX_SYMS];
+    size_t count;
+    uint32_t max;
+} cminus_profile;
+
+extern cminus_profile cminus_prof;
+
+extern const char* cminus_debug_file; /* source file named by -g line info */
+
+inline void cminus_parse(char* file, size_t file_len, char* string_buffer, size_t string_len, FILE* asm_file, cminus_flags flags);
 inline void cminus_handle_token(cminus_state* state);
 inline void cminus_handle_keyword(cminus_state* state, bool func);
 inline void cminus_write_line(cminus_state* state, const char* format, ...);
+inline bool cminus_profile_load(char* data, size_t len);
 
-typedef struct cminus_sym {
-    char sym[MAX_SYM_NAME];
-    size_t scope, index;
-} cminus_sym;
-
-inline void cminus_push_sym(char* name, size_t index, size_t scope);
+inline void cminus_push_sym(char* name, size_t index, size_t scope, cminus_type type);
 inline cminus_sym* cminus_find_sym(char* sym, size_t scope);
 inline void cminus_pop_sym(size_t scope);
 
@@ -58,47 +186,335 @@ inline void cminus_pop_sym(size_t scope);
 #include <stdbool.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
 
 #define STB_C_LEXER_IMPLEMENTATION
 #include "stb_c_lexer.h"
 
+const cminus_target cminus_i386 = {4, "eax", "esp", "ebp", {"eax", "edx"}, 2, "ecx", "edx", "esi", "edi"};
+const cminus_target cminus_x86_64 = {8, "rax", "rsp", "rbp", {"rdi", "rsi", "rdx", "rcx", "r8", "r9"}, 6, "rcx", "rdx", "rsi", "rdi"};
+
 cminus_sym cminus_syms[MAX_STACK][MAX_SYMS];
 size_t cminus_sym_count[MAX_STACK];
+cminus_stats cminus_stat;
+cminus_profile cminus_prof = {.path = "cminus.prof"};
+const char* cminus_debug_file = "";
+
+cminus_record cminus_records[MAX_RECORDS];
+size_t cminus_record_count;
+cminus_sym cminus_member; /* the member cminus_lookup returns */
+
+/* unique string literals of the file, NUL terminated in the pool */
+char cminus_string_pool[CMINUS_STRING_POOL];
+size_t cminus_string_pool_len;
+struct { size_t offset, len; } cminus_strings[MAX_STRINGS];
+size_t cminus_string_count;
+
+/* functions with entry counters, in the order they were defined */
+char cminus_prof_funcs[MAX_SYMS][MAX_SYM_NAME];
+size_t cminus_prof_func_count;
+
+double cminus_stats_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+/* whether an emitted line leaves eax alone, stores are only emitted by cminus_store_sym or are followed by cminus_ax_forget */
+bool cminus_ax_kept(cminus_state* state, const char* line) {
+    if (line[0] == '\0' || line[0] == ';' || strncmp(line, "push ", 5) == 0)
+        return true;
+
+    /* moving the stack pointer doesn't change what a variable holds */
+    if (strncmp(line, "sub ", 4) == 0 || strncmp(line, "add ", 4) == 0)
+        return strncmp(&line[4], state->target->sp, 3) == 0 && line[7] == ',';
+
+    if (strncmp(line, "mov ", 4))
+        return false;
+
+    const char* ax[] = {"eax,", "ax,", "al,", "ah,", "rax,"};
+    for (size_t i = 0; i < sizeof(ax) / sizeof(ax[0]); i++)
+        if (strncmp(&line[4], ax[i], strlen(ax[i])) == 0)
+            return false;
+    return true;
+}
 
 void cminus_write_line(cminus_state* state, const char* format, ...) {
+    double start = cminus_stat.enabled ? cminus_stats_ms() : 0;
     size_t max = state->asm_index + (state->scope * 4);
+    int bytes = 0;
+
+    /* nasm attributes the following lines to this source line in the dwarf line table */
+    if ((state->flags & cminus_debug) && state->line != state->line_emitted) {
+        bytes += fprintf(state->asm_file, "%%line %lu+0 %s\n", state->line, cminus_debug_file);
+        state->line_emitted = state->line;
+    }
 
     for (state->asm_index; state->asm_index < max; state->asm_index++) {
-        fprintf(state->asm_file, " ");
+        bytes += fprintf(state->asm_file, " ");
     }
 
+    char buffer[0x1000];
+    char* line = buffer;
     va_list args;
     va_start(args, format);
-    vfprintf(state->asm_file, format, args);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
     va_end(args);
 
-    fprintf(state->asm_file, "\n");
+    if (len >= (int)sizeof(buffer)) {
+        line = malloc(len + 1);
+        va_start(args, format);
+        vsnprintf(line, len + 1, format, args);
+        va_end(args);
+    }
+
+    bytes += fprintf(state->asm_file, "%s\n", line);
+    if (!cminus_ax_kept(state, line))
+        state->ax_count = 0;
+    if (line != buffer)
+        free(line);
+
+    cminus_stat.lines++;
+    cminus_stat.bytes += bytes;
+    if (cminus_stat.enabled) cminus_stat.emit_ms += cminus_stats_ms() - start;
+}
+
+/* move the line count up to the current token, tokens only move forward so this is linear */
+void cminus_track_line(cminus_state* state) {
+    for (; state->line_pos < state->lexer->where_firstchar; state->line_pos++)
+        if (*state->line_pos == '\n') state->line++;
+}
+
+/* get the next token, lookahead tokens are lexed again once they are reached */
+int cminus_lex(stb_lexer* lexer, bool lookahead) {
+    double start = cminus_stat.enabled ? cminus_stats_ms() : 0;
+    int ret = stb_c_lexer_get_token(lexer);
+
+    if (lookahead) cminus_stat.relexed++;
+    else cminus_stat.tokens++;
+    if (cminus_stat.enabled) cminus_stat.lex_ms += cminus_stats_ms() - start;
+    return ret;
+}
+
+/* switch sections, if needed */
+void cminus_section(cminus_state* state, const char* section) {
+    if (state->section && strcmp(state->section, section) == 0)
+        return;
+
+    state->section = section;
+    cminus_write_line(state, "section %s", section);
+}
+
+bool cminus_profile_load(char* data, size_t len) {
+    cminus_prof.count = 0;
+    cminus_prof.max = 0;
+
+    size_t i = 0;
+    while (i + 4 < len && cminus_prof.count < MAX_SYMS) {
+        uint32_t count;
+        memcpy(&count, &data[i], 4);
+        i += 4;
+
+        size_t name_len = strnlen(&data[i], len - i);
+        if (i + name_len >= len || name_len >= MAX_SYM_NAME)
+            return false;
+
+        memcpy(cminus_prof.names[cminus_prof.count], &data[i], name_len + 1);
+        cminus_prof.counts[cminus_prof.count] = count;
+        if (count > cminus_prof.max) cminus_prof.max = count;
+        cminus_prof.count++;
+        i += name_len + 1;
+    }
+
+    return i == len;
+}
+
+/* 
+    section of a function from its profile, functions that never ran go to .text.unlikely
+    and the ones that ran at least 1/16th as often as the hottest one to .text.hot, so ld groups them together
+*/
+const char* cminus_func_section(cminus_state* state, const char* name) {
+    if (!(state->flags & cminus_profile_use))
+        return ".text";
+
+    for (size_t i = 0; i < cminus_prof.count; i++) {
+        if (strcmp(cminus_prof.names[i], name))
+            continue;
+
+        if (cminus_prof.counts[i] == 0)
+            return ".text.unlikely";
+        if (cminus_prof.counts[i] >= cminus_prof.max / 16)
+            return ".text.hot";
+        break;
+    }
+
+    return ".text";
 }
 
-void cminus_push_sym(char* name, size_t index, size_t scope) {            
+void cminus_push_sym(char* name, size_t index, size_t scope, cminus_type type) {            
     cminus_syms[scope][cminus_sym_count[scope]].index = index;
+    cminus_syms[scope][cminus_sym_count[scope]].offset = 0;
     cminus_syms[scope][cminus_sym_count[scope]].scope = scope;
+    cminus_syms[scope][cminus_sym_count[scope]].type = type;
     strncpy(cminus_syms[scope][cminus_sym_count[scope]].sym, name, 255);
 
     cminus_sym_count[scope]++;
 }
 
 cminus_sym* cminus_find_sym(char* sym, size_t scope) {
-    for (size_t i = 0; i < cminus_sym_count[scope]; i++)
-        if (strcmp(sym, cminus_syms[scope][i].sym) == 0)
-            return &cminus_syms[scope][i];
+    double start = cminus_stat.enabled ? cminus_stats_ms() : 0;
+    size_t probes = 0;
+    cminus_sym* found = NULL;
+    cminus_stat.find_sym_calls++;
+
+    /* the current scope, then the globals */
+    for (;;) {
+        for (size_t i = 0; i < cminus_sym_count[scope] && found == NULL; i++, probes++)
+            if (strcmp(sym, cminus_syms[scope][i].sym) == 0)
+                found = &cminus_syms[scope][i];
+        
+        if (found || scope == 0)
+            break;
+        scope = 0;
+    }
+
+    cminus_stat.find_sym_probes += probes;
+    if (probes > cminus_stat.find_sym_max_probes) cminus_stat.find_sym_max_probes = probes;
+    if (cminus_stat.enabled) cminus_stat.sym_ms += cminus_stats_ms() - start;
     
-    if (scope)
-        return cminus_find_sym(sym, 0);
-    else { 
+    if (found == NULL) { 
         fprintf(stderr, "Error: symbol not found: %s\n", sym);
         exit(1);
     }
+
+    return found;
+}
+
+size_t cminus_type_align(cminus_type type) {
+    return type.record ? cminus_records[type.record - 1].align : type.size;
+}
+
+cminus_record* cminus_find_record(char* name, bool is_union) {
+    for (size_t i = 0; i < cminus_record_count; i++)
+        if (cminus_records[i].is_union == is_union && strcmp(cminus_records[i].name, name) == 0)
+            return &cminus_records[i];
+
+    fprintf(stderr, "Error: unknown %s: %s\n", is_union ? "union" : "struct", name);
+    exit(1);
+}
+
+/* a variable, or a member of one like "p.pos.x", which is returned as a copy with the member's offset and type */
+cminus_sym* cminus_lookup(cminus_state* state, char* name) {
+    char base[MAX_SYM_NAME];
+    char* dot = strchr(name, '.');
+    if (dot == NULL)
+        return cminus_find_sym(name, state->scope);
+
+    snprintf(base, sizeof(base), "%.*s", (int)(dot - name), name);
+    cminus_member = *cminus_find_sym(base, state->scope);
+
+    while (dot) {
+        char* field = dot + 1;
+        dot = strchr(field, '.');
+        size_t len = dot ? (size_t)(dot - field) : strlen(field);
+        
+        if (cminus_member.type.record == 0) {
+            fprintf(stderr, "Error: %s is not a struct or union\n", name);
+            exit(1);
+        }
+
+        cminus_record* record = &cminus_records[cminus_member.type.record - 1];
+        size_t i = 0;
+        for (; i < record->field_count; i++)
+            if (strlen(record->fields[i].name) == len && strncmp(record->fields[i].name, field, len) == 0)
+                break;
+
+        if (i == record->field_count) {
+            fprintf(stderr, "Error: %s has no member %.*s\n", record->name, (int)len, field);
+            exit(1);
+        }
+
+        cminus_member.offset += record->fields[i].offset;
+        cminus_member.type = record->fields[i].type;
+    }
+
+    return &cminus_member;
+}
+
+/* 
+    place the fields of a record, each at the next multiple of its alignment, and pad the size to the largest one
+    with -freorder-fields the fields are sorted by alignment first (stable, so equal ones keep their order), which leaves no padding between them
+*/
+void cminus_layout_record(cminus_state* state, cminus_record* record) {
+    if ((state->flags & cminus_reorder_fields) && !record->is_union) {
+        for (size_t i = 1; i < record->field_count; i++) {
+            cminus_field field = record->fields[i];
+            size_t j = i;
+            for (; j > 0 && cminus_type_align(record->fields[j - 1].type) < cminus_type_align(field.type); j--)
+                record->fields[j] = record->fields[j - 1];
+            record->fields[j] = field;
+        }
+    }
+
+    size_t offset = 0;
+    record->align = 1;
+    for (size_t i = 0; i < record->field_count; i++) {
+        cminus_field* field = &record->fields[i];
+        size_t align = cminus_type_align(field->type);
+        if (align > record->align) record->align = align;
+
+        if (record->is_union) {
+            field->offset = 0;
+            if (field->type.size > offset) offset = field->type.size;
+            continue;
+        }
+
+        offset = (offset + align - 1) / align * align;
+        field->offset = offset;
+        offset += field->type.size;
+    }
+
+    record->size = (offset + record->align - 1) / record->align * record->align;
+    if (record->size == 0) record->size = record->align;
+}
+
+/* whether two syms are the same variable, or overlapping members of one */
+bool cminus_sym_overlaps(cminus_sym* a, cminus_sym* b) {
+    if (a->scope != b->scope || a->index != b->index || strcmp(a->sym, b->sym))
+        return false;
+    return a->offset < b->offset + b->type.size && b->offset < a->offset + a->type.size;
+}
+
+/* 
+    redundant load elimination: eax remembers which variables it holds since the last line that changed it,
+    so reading a variable again, or reading the one that was just stored, emits nothing
+    labels, calls and anything else that writes eax forget everything, so this never crosses control flow
+*/
+cminus_sym* cminus_ax_find(cminus_state* state, cminus_sym* sym) {
+    for (size_t i = 0; i < state->ax_count; i++) {
+        cminus_sym* held = &state->ax_syms[i];
+        if (cminus_sym_overlaps(held, sym) && held->offset == sym->offset && held->type.size == sym->type.size && held->type.is_unsigned == sym->type.is_unsigned)
+            return held;
+    }
+    return NULL;
+}
+
+void cminus_ax_hold(cminus_state* state, cminus_sym* sym) {
+    if (state->ax_count < CMINUS_AX_SYMS && cminus_ax_find(state, sym) == NULL)
+        state->ax_syms[state->ax_count++] = *sym;
+}
+
+/* a store to sym, whatever eax held of it is stale */
+void cminus_ax_store(cminus_state* state, cminus_sym* sym) {
+    size_t count = 0;
+    for (size_t i = 0; i < state->ax_count; i++)
+        if (!cminus_sym_overlaps(&state->ax_syms[i], sym))
+            state->ax_syms[count++] = state->ax_syms[i];
+    state->ax_count = count;
+}
+
+void cminus_ax_forget(cminus_state* state) {
+    state->ax_count = 0;
 }
 
 void cminus_pop_sym(size_t scope) {
@@ -107,28 +523,144 @@ void cminus_pop_sym(size_t scope) {
 }
 
 
-int32_t cminus_load_rvalue(cminus_state* state, char* reg) {
-    int32_t val = 0;
+/* fills in the memory operand of a symbol, eg. "[esp + 4]" or "[a + 4]" */
+void cminus_sym_addr(cminus_state* state, cminus_sym* sym, size_t offset, char* out) {
+    offset += sym->offset;
+    if (sym->scope)
+        sprintf(out, "[%s + %lu]", state->target->sp, (state->depth - 1 - sym->index) * state->target->word + offset);
+    else if (offset)
+        sprintf(out, "[%s + %lu]", sym->sym, offset);
+    else
+        sprintf(out, "[%s]", sym->sym);
+}
+
+/* truncate a constant to the storage of a type */
+int64_t cminus_truncate(int64_t val, cminus_type type) {
+    switch (type.size) {
+        case 1: return type.is_unsigned ? (int64_t)(uint8_t)val : (int64_t)(int8_t)val;
+        case 2: return type.is_unsigned ? (int64_t)(uint16_t)val : (int64_t)(int16_t)val;
+        case 4: return type.is_unsigned ? (int64_t)(uint32_t)val : (int64_t)(int32_t)val;
+        default: return val;
+    }
+}
+
+/* 
+    load a symbol into eax, extended to 32bits
+    if the destination is 64bit, the high half is loaded into edx (or the value into rax with -m64)
+*/
+void cminus_load_sym(cminus_state* state, cminus_sym* sym, cminus_type dest) {
+    char addr[MAX_SYM_NAME + 32];
+    if (sym->type.record) {
+        fprintf(stderr, "Error: %s is a struct, only its members can be used as values\n", sym->sym);
+        exit(1);
+    }
+
+    /* a held value is only the low 32bits, with -m64 zero extending to rax relies on the load itself */
+    bool extends = (dest.size == 8) && (sym->type.size == 8 || ((state->flags & cminus_m64) && sym->type.is_unsigned));
+    if (!extends && cminus_ax_find(state, sym)) {
+        cminus_stat.loads_removed++;
+        if (dest.size != 8)
+            return;
+    } else {
+        cminus_sym_addr(state, sym, 0, addr);
+
+        if ((state->flags & cminus_m64) && sym->type.size == 8 && dest.size == 8) {
+            cminus_write_line(state, "mov rax, %s", addr);
+            return;
+        }
+
+        char* ext = sym->type.is_unsigned ? "movzx" : "movsx";
+        switch (sym->type.size) {
+            case 1: cminus_write_line(state, "%s eax, byte %s", ext, addr); break;
+            case 2: cminus_write_line(state, "%s eax, word %s", ext, addr); break;
+            default: cminus_write_line(state, "mov eax, %s", addr); break;
+        }
+
+        if (dest.size != 8) {
+            cminus_ax_hold(state, sym);
+            return;
+        }
+    }
+
+    if (state->flags & cminus_m64) { /* 64bit values fit in rax, writing eax already zero extends */
+        if (!sym->type.is_unsigned)
+            cminus_write_line(state, "movsxd rax, eax");
+    } else if (sym->type.size == 8) {
+        cminus_sym_addr(state, sym, 4, addr);
+        cminus_write_line(state, "mov edx, %s", addr);
+    } else if (sym->type.is_unsigned)
+        cminus_write_line(state, "xor edx, edx");
+    else
+        cminus_write_line(state, "cdq");
+}
+
+/* store eax (edx:eax or rax for 64bit) into a symbol */
+void cminus_store_sym(cminus_state* state, cminus_sym* sym) {
+    char addr[MAX_SYM_NAME + 32];
+    if (sym->type.record) {
+        fprintf(stderr, "Error: %s is a struct, only its members can be assigned\n", sym->sym);
+        exit(1);
+    }
+
+    cminus_sym_addr(state, sym, 0, addr);
+
+    switch (sym->type.size) {
+        case 1: cminus_write_line(state, "mov byte %s, al", addr); break;
+        case 2: cminus_write_line(state, "mov word %s, ax", addr); break;
+        case 8:
+            if (state->flags & cminus_m64) {
+                cminus_write_line(state, "mov %s, rax", addr);
+                break;
+            }
+
+            cminus_write_line(state, "mov %s, eax", addr);
+            cminus_sym_addr(state, sym, 4, addr);
+            cminus_write_line(state, "mov %s, edx", addr);
+            break;
+        default: cminus_write_line(state, "mov %s, eax", addr); break;
+    }
+
+    /* the low 32bits of eax are what loading it back would give */
+    cminus_ax_store(state, sym);
+    if (sym->type.size >= 4)
+        cminus_ax_hold(state, sym);
+}
+
+int64_t cminus_load_rvalue(cminus_state* state, char* reg, cminus_type type) {
+    int64_t val = 0;
     switch (state->prev.token) {
+        case CLEX_charlit:
         case CLEX_intlit:
-            val = state->prev.int_number;
-            if (state->scope)  cminus_write_line(state, "mov %s, %i", reg, val);
+            val = cminus_truncate(state->prev.int_number, type);
+            if (state->scope == 0) break;
+
+            if (type.size == 8 && (state->flags & cminus_m64))
+                cminus_write_line(state, "mov %s, %lli", state->target->ax, (long long)val);
+            else
+                cminus_write_line(state, "mov %s, %i", reg, (int32_t)val);
+
+            if (type.size == 8 && !(state->flags & cminus_m64)) 
+                cminus_write_line(state, "mov edx, %i", (int32_t)(val >> 32));
             break;
         case CLEX_id: {
-            if (strcmp(state->sym[0], state->prev.string) == 0)
+            if (strcmp(state->sym[0], state->rvalue) == 0)
                 break;
             
-            cminus_sym* sym = cminus_find_sym(state->prev.string, state->scope);
+            cminus_sym* sym = cminus_lookup(state, state->rvalue);
             val =  0;
-            if (state->scope && sym->scope) 
-                cminus_write_line(state, "mov %s, [esp + %lu]", reg, sym->index * 4);
-            else if (state->scope) {
-                cminus_write_line(state, "mov %s, %s", reg, sym->sym);
-            }
-            else {
+            if (state->scope == 0) {
                 fprintf(stderr, "error: global variable rvalue must be a constant\n");
                 exit(1);
             }
+
+            cminus_load_sym(state, sym, type);
+            /* narrow the value to the destination */
+            char* ext = type.is_unsigned ? "movzx" : "movsx";
+            if (type.size < sym->type.size && type.size == 1)
+                cminus_write_line(state, "%s eax, al", ext);
+            else if (type.size < sym->type.size && type.size == 2)
+                cminus_write_line(state, "%s eax, ax", ext);
+            break;
         }
         default: break;
     }
@@ -136,52 +668,1186 @@ int32_t cminus_load_rvalue(cminus_state* state, char* reg) {
     return val;
 }
 
+/* put what an arg points to in reg: &x is the address of x, a string is the address of the literal, anything else is a pointer value */
+void cminus_load_address(cminus_state* state, char* arg, const char* reg) {
+    char addr[MAX_SYM_NAME + 32];
+    if (arg[0] == '&') {
+        cminus_sym_addr(state, cminus_lookup(state, &arg[1]), 0, addr);
+        cminus_write_line(state, "lea %s, %s", reg, addr);
+        return;
+    }
+
+    if (strncmp(arg, "__cminus_str_", 13) == 0) {
+        cminus_write_line(state, "mov %s, %s", reg, arg);
+        return;
+    }
+
+    cminus_load_sym(state, cminus_lookup(state, arg), (cminus_type){state->target->word, false});
+    if (strcmp(reg, state->target->ax))
+        cminus_write_line(state, "mov %s, %s", reg, state->target->ax);
+}
+
+/* load a constant or a variable arg into eax, widened to rax with -m64 */
+void cminus_load_arg(cminus_state* state, char* arg) {
+    if ((arg[0] >= '0' && arg[0] <= '9') || arg[0] == '-')
+        cminus_write_line(state, "mov eax, %s", arg);
+    else
+        cminus_load_sym(state, cminus_lookup(state, arg), (cminus_type){state->target->word, false});
+}
+
+/* memory operand offset bytes into what an arg points to, a pointer value must already be in reg */
+void cminus_builtin_operand(cminus_state* state, char* arg, const char* reg, size_t offset, char* out) {
+    if (arg[0] == '&')
+        cminus_sym_addr(state, cminus_lookup(state, &arg[1]), offset, out);
+    else
+        sprintf(out, "[%s + %lu]", reg, offset);
+}
+
+/* 
+    __builtin_memcpy(dst, src, n), __builtin_memset(dst, c, n) and __builtin_memcmp(a, b, n), expanded inline
+    constant sizes up to CMINUS_UNROLL_MEM become word moves (then 4, 2 and 1 byte ones for the tail) straight between the operands,
+    larger constant sizes become rep movs / rep stos by word and single string instructions for the tail,
+    other sizes split the count at runtime, memcmp always uses repe cmpsb
+*/
+void cminus_load_builtin(cminus_state* state, char* name) {
+    const cminus_target* target = state->target;
+    if (state->sym_count != 4) {
+        fprintf(stderr, "Error: %s takes 3 args\n", name);
+        exit(1);
+    }
+
+    bool is_copy = strcmp(name, "__builtin_memcpy") == 0, is_set = strcmp(name, "__builtin_memset") == 0;
+    if (!is_copy && !is_set && strcmp(name, "__builtin_memcmp")) {
+        fprintf(stderr, "Error: unknown builtin %s\n", name);
+        exit(1);
+    }
+
+    const char* regs[] = {"al", "ax", "eax", "rax"};
+    const char* sizes[] = {"byte", "word", "dword", "qword"};
+    const char* suffixes = "bwdq";
+    size_t word = target->word, shift = (word == 8) ? 3 : 2;
+    char* dst = state->sym[1], *src = state->sym[2], *count = state->sym[3];
+    bool constant = (count[0] >= '0' && count[0] <= '9');
+    size_t n = constant ? strtoull(count, NULL, 0) : 0;
+    char a[MAX_SYM_NAME + 32], b[MAX_SYM_NAME + 32];
+
+    cminus_write_line(state, "");
+    cminus_write_line(state, "; %s", name);
+
+    /* memset repeats the byte in every byte of eax (rax) */
+    #define CMINUS_LOAD_PATTERN() do { \
+        if (src[0] >= '0' && src[0] <= '9') { \
+            uint64_t pattern = (strtoull(src, NULL, 0) & 0xFF) * 0x0101010101010101ULL; \
+            cminus_write_line(state, "mov %s, %llu", target->ax, (unsigned long long)(pattern & ((word == 8) ? ~0ULL : 0xFFFFFFFFULL))); \
+        } else { \
+            cminus_load_arg(state, src); \
+            cminus_write_line(state, "movzx eax, al"); \
+            cminus_write_line(state, "mov %s, %s", target->cx, (word == 8) ? "0x0101010101010101" : "0x01010101"); \
+            cminus_write_line(state, "imul %s, %s", target->ax, target->cx); \
+        } \
+    } while (0)
+
+    if (constant && n <= CMINUS_UNROLL_MEM && (is_copy || is_set)) {
+        if (dst[0] != '&') cminus_load_address(state, dst, is_copy ? target->cx : target->dx);
+        if (is_copy && src[0] != '&') cminus_load_address(state, src, target->dx);
+        if (is_set) CMINUS_LOAD_PATTERN();
+
+        for (size_t offset = 0; offset < n;) {
+            size_t chunk = word, part = shift;
+            while (chunk > n - offset) { chunk /= 2; part--; }
+
+            if (is_copy) {
+                cminus_builtin_operand(state, src, target->dx, offset, b);
+                cminus_write_line(state, "mov %s, %s", regs[part], b);
+            }
+
+            cminus_builtin_operand(state, dst, is_copy ? target->cx : target->dx, offset, a);
+            cminus_write_line(state, "mov %s %s, %s", sizes[part], a, regs[part]);
+            offset += chunk;
+        }
+    } else {
+        /* esi and edi belong to the caller on i386 */
+        if (word == 4) {
+            cminus_write_line(state, "push esi");
+            cminus_write_line(state, "push edi");
+            state->depth += 2;
+        }
+
+        if (!constant) {
+            cminus_load_arg(state, count);
+            cminus_write_line(state, "mov %s, %s", target->dx, target->ax);
+        }
+
+        /* movs and stos write to edi, movs reads from esi, cmps compares [esi] to [edi] */
+        cminus_load_address(state, dst, (is_copy || is_set) ? target->di : target->si);
+        if (is_set)
+            CMINUS_LOAD_PATTERN();
+        else
+            cminus_load_address(state, src, is_copy ? target->si : target->di);
+
+        char* op = is_copy ? "movs" : is_set ? "stos" : "cmps";
+        if (!is_copy && !is_set) {
+            if (constant) cminus_write_line(state, "mov %s, %lu", target->cx, n);
+            else cminus_write_line(state, "mov %s, %s", target->cx, target->dx);
+            cminus_write_line(state, "cmp eax, eax"); /* equal when n is 0 */
+            cminus_write_line(state, "repe cmpsb");
+            cminus_write_line(state, "seta al");
+            cminus_write_line(state, "setb cl");
+            cminus_write_line(state, "movzx eax, al");
+            cminus_write_line(state, "movzx ecx, cl");
+            cminus_write_line(state, "sub eax, ecx");
+        } else if (constant) {
+            cminus_write_line(state, "mov %s, %lu", target->cx, n >> shift);
+            cminus_write_line(state, "rep %s%c", op, suffixes[shift]);
+            for (size_t part = shift; part-- > 0;)
+                if (n & (1 << part))
+                    cminus_write_line(state, "%s%c", op, suffixes[part]);
+        } else {
+            cminus_write_line(state, "mov %s, %s", target->cx, target->dx);
+            cminus_write_line(state, "shr %s, %lu", target->cx, shift);
+            cminus_write_line(state, "rep %s%c", op, suffixes[shift]);
+            cminus_write_line(state, "mov %s, %s", target->cx, target->dx);
+            cminus_write_line(state, "and %s, %lu", target->cx, word - 1);
+            cminus_write_line(state, "rep %sb", op);
+        }
+
+        if (word == 4) {
+            cminus_write_line(state, "pop edi");
+            cminus_write_line(state, "pop esi");
+            state->depth -= 2;
+        }
+    }
+    #undef CMINUS_LOAD_PATTERN
+    cminus_ax_forget(state); /* memory written through pointers */
+
+    /* memcpy and memset return dst */
+    if ((is_copy || is_set) && (state->type & (cminus_var | cminus_set)))
+        cminus_load_address(state, dst, target->ax);
+}
+
+#define MAX_ASM_BINDS 8
+
+/* 
+    size of a register asm can bind, 0 if the target doesn't have it
+    full is set to the word sized register it is part of, index 0 is the accumulator
+    high byte registers (ah, ...) are left out, they would be clobbered by loading the other bindings through eax
+*/
+size_t cminus_asm_reg(cminus_state* state, const char* reg, const char** full) {
+    static const char* regs[][5] = {
+        {"al", "ax", "eax", "rax"}, {"bl", "bx", "ebx", "rbx"}, {"cl", "cx", "ecx", "rcx"}, {"dl", "dx", "edx", "rdx"},
+        {"sil", "si", "esi", "rsi"}, {"dil", "di", "edi", "rdi"}, {"bpl", "bp", "ebp", "rbp"},
+        {"r8b", "r8w", "r8d", "r8"}, {"r9b", "r9w", "r9d", "r9"}, {"r10b", "r10w", "r10d", "r10"}, {"r11b", "r11w", "r11d", "r11"},
+        {"r12b", "r12w", "r12d", "r12"}, {"r13b", "r13w", "r13d", "r13"}, {"r14b", "r14w", "r14d", "r14"}, {"r15b", "r15w", "r15d", "r15"},
+    };
+
+    bool is_m64 = (state->flags & cminus_m64);
+    for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); i++) {
+        for (size_t j = 0; j < 4; j++) {
+            if (strcmp(reg, regs[i][j]))
+                continue;
+            
+            /* i386 has no 64bit registers, no r8-r15 and no byte registers of esi, edi and ebp */
+            if (!is_m64 && (j == 3 || i >= 7 || (j == 0 && i >= 4)))
+                return 0;
+
+            *full = regs[i][is_m64 ? 3 : 2];
+            return (size_t)1 << j;
+        }
+    }
+
+    return 0;
+}
+
+/* whether a word sized register is callee-saved, asm blocks that bind one save it */
+bool cminus_asm_saved(cminus_state* state, const char* full) {
+    const char* i386[] = {"ebx", "esi", "edi", "ebp"};
+    const char* m64[] = {"rbx", "rbp", "r12", "r13", "r14", "r15"};
+    
+    bool is_m64 = (state->flags & cminus_m64);
+    size_t count = is_m64 ? sizeof(m64) / sizeof(m64[0]) : sizeof(i386) / sizeof(i386[0]);
+    for (size_t i = 0; i < count; i++)
+        if (strcmp(full, is_m64 ? m64[i] : i386[i]) == 0)
+            return true;
+    return false;
+}
+
+/* 
+    asm("...") splices instructions into the output, separated by newlines or ';'
+    %[x] is replaced by the memory operand of x, eg. dword [esp + 4]
+    %[x:reg] loads x into reg before the block, is replaced by reg and stores reg back to x after the block,
+    reg may be of any width, the value is truncated to it and extended back to x
+    values never stay in registers between statements, so the block may clobber eax, ecx and edx (and the arg registers with -m64),
+    callee-saved registers that are bound are saved around it, anything else it changes has to be restored by the block
+*/
+void cminus_load_asm(cminus_state* state, char* text) {
+    struct { char name[MAX_SYM_NAME]; char reg[16]; size_t size; const char* full; } binds[MAX_ASM_BINDS];
+    const char* ax[] = {"", "al", "ax", "", "eax", "", "", "", "rax"}; /* the accumulator of each width */
+    size_t bind_count = 0;
+    const char* saved[MAX_ASM_BINDS];
+    size_t saved_count = 0;
+
+    for (char* c = strstr(text, "%["); c; c = strstr(c + 2, "%[")) {
+        char* end = strchr(c, ']');
+        char* colon = memchr(c, ':', end ? (size_t)(end - c) : 0);
+        if (end == NULL) {
+            fprintf(stderr, "Error: asm: missing ] after %%[\n");
+            exit(1);
+        }
+
+        if (colon == NULL)
+            continue;
+
+        /* the same binding can be used more than once */
+        bool bound = false;
+        for (size_t i = 0; i < bind_count; i++)
+            if (strncmp(binds[i].name, c + 2, (size_t)(colon - c - 2)) == 0 && binds[i].name[colon - c - 2] == '\0')
+                bound = true;
+        if (bound)
+            continue;
+
+        if (bind_count == MAX_ASM_BINDS) {
+            fprintf(stderr, "Error: asm: too many bound registers\n");
+            exit(1);
+        }
+
+        snprintf(binds[bind_count].name, MAX_SYM_NAME, "%.*s", (int)(colon - c - 2), c + 2);
+        snprintf(binds[bind_count].reg, 16, "%.*s", (int)(end - colon - 1), colon + 1);
+        
+        cminus_sym* sym = cminus_lookup(state, binds[bind_count].name);
+        if (sym->type.record || sym->type.size > state->target->word) {
+            fprintf(stderr, "Error: asm: %s doesn't fit in a register\n", binds[bind_count].name);
+            exit(1);
+        }
+
+        binds[bind_count].size = cminus_asm_reg(state, binds[bind_count].reg, &binds[bind_count].full);
+        if (binds[bind_count].size == 0) {
+            fprintf(stderr, "Error: asm: %s can't be bound to a variable on this target\n", binds[bind_count].reg);
+            exit(1);
+        }
+
+        const char* full = binds[bind_count].full;
+        bind_count++;
+        if (!cminus_asm_saved(state, full)) full = NULL;
+        for (size_t i = 0; full && i < saved_count; i++)
+            if (strcmp(saved[i], full) == 0) full = NULL;
+        if (full) saved[saved_count++] = full;
+    }
+
+    cminus_write_line(state, "");
+    cminus_write_line(state, "; asm");
+    for (size_t i = 0; i < saved_count; i++) {
+        cminus_write_line(state, "push %s", saved[i]);
+        state->depth++;
+    }
+
+    /* values go through eax, so the one bound to the accumulator is loaded last */
+    for (size_t pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < bind_count; i++) {
+            bool is_ax = strcmp(binds[i].full, state->target->ax) == 0;
+            if (is_ax != (pass == 1)) continue;
+
+            /* a 64bit register gets the value extended to rax, narrower ones take the low bytes of eax */
+            cminus_sym* sym = cminus_lookup(state, binds[i].name);
+            cminus_load_sym(state, sym, (cminus_type){binds[i].size == 8 ? 8 : 4, sym->type.is_unsigned});
+            if (!is_ax)
+                cminus_write_line(state, "mov %s, %s", binds[i].reg, ax[binds[i].size]);
+        }
+    }
+
+    char line[0x1000];
+    size_t len = 0;
+    for (char* c = text;; c++) {
+        if (*c == '\0' || *c == '\n' || *c == ';') {
+            line[len] = '\0';
+            char* start = line;
+            while (*start == ' ' || *start == '\t') start++;
+            if (*start) cminus_write_line(state, "%s", start);
+            len = 0;
+            if (*c == '\0') break;
+            continue;
+        }
+
+        if (c[0] == '%' && c[1] == '[') {
+            char* end = strchr(c, ']');
+            char* colon = memchr(c, ':', (size_t)(end - c));
+            char operand[MAX_SYM_NAME + 48];
+            if (colon) {
+                snprintf(operand, sizeof(operand), "%.*s", (int)(end - colon - 1), colon + 1);
+            } else {
+                const char* sizes[] = {"", "byte ", "word ", "", "dword ", "", "", "", "qword "};
+                char name[MAX_SYM_NAME], addr[MAX_SYM_NAME + 32];
+                snprintf(name, sizeof(name), "%.*s", (int)(end - c - 2), c + 2);
+                cminus_sym* sym = cminus_lookup(state, name);
+                cminus_sym_addr(state, sym, 0, addr);
+                snprintf(operand, sizeof(operand), "%s%s", (!sym->type.record && sym->type.size <= 8) ? sizes[sym->type.size] : "", addr);
+            }
+
+            size_t size = strlen(operand);
+            if (len + size < sizeof(line)) {
+                memcpy(&line[len], operand, size);
+                len += size;
+            }
+            c = end;
+            continue;
+        }
+
+        if (len + 1 < sizeof(line))
+            line[len++] = *c;
+    }
+
+    /* the accumulator is stored first, the others are stored through it */
+    for (size_t pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < bind_count; i++) {
+            bool is_ax = strcmp(binds[i].full, state->target->ax) == 0;
+            if (is_ax != (pass == 0)) continue;
+
+            /* extend the register back to the variable, stores take their bytes from eax (rax) */
+            cminus_sym* sym = cminus_lookup(state, binds[i].name);
+            size_t size = binds[i].size;
+            if (size < 4 && size < sym->type.size)
+                cminus_write_line(state, "%s eax, %s", sym->type.is_unsigned ? "movzx" : "movsx", binds[i].reg);
+            else if (size == 4 && sym->type.size == 8 && !sym->type.is_unsigned)
+                cminus_write_line(state, "movsxd rax, %s", binds[i].reg);
+            else if (size == 4 && sym->type.size == 8) /* writing the 32bit register zero extends */
+                cminus_write_line(state, "mov eax, %s", binds[i].reg);
+            else if (!is_ax)
+                cminus_write_line(state, "mov %s, %s", ax[size], binds[i].reg);
+            cminus_store_sym(state, sym);
+        }
+    }
+
+    for (size_t i = saved_count; i-- > 0;) {
+        cminus_write_line(state, "pop %s", saved[i]);
+        state->depth--;
+    }
+    cminus_ax_forget(state); /* the block may store anywhere */
+}
+
+/* 
+    evaluate a call in a global initializer at compile time, eg. int table = f(3);
+    the functions emitted so far are run in the emulator, the call has to take constant args, return without syscalls
+    and not write to globals, so folding its result into .data is the same as calling it at startup
+*/
+int64_t cminus_eval_call(cminus_state* state, char* callee) {
+    const cminus_target* target = state->target;
+    for (size_t i = 1; i < state->sym_count; i++) {
+        if (!((state->sym[i][0] >= '0' && state->sym[i][0] <= '9') || state->sym[i][0] == '-')) {
+            fprintf(stderr, "Error: %s(): args of a call in a global initializer must be constants\n", callee);
+            exit(1);
+        }
+    }
+
+    /* room for the harness, every arg is moved or pushed on its own line */
+    size_t harness = 256 + strlen(callee);
+    for (size_t i = 1; i < state->sym_count; i++)
+        harness += strlen(state->sym[i]) + 32;
+
+    fflush(state->asm_file);
+    long end = ftell(state->asm_file);
+    char* text = malloc((size_t)end + harness);
+    size_t len = 0;
+    char line[0x1000];
+    
+    rewind(state->asm_file);
+    while (ftell(state->asm_file) < end && fgets(line, sizeof(line), state->asm_file)) {
+        if (strstr(line, "[__cminus_prof_fn_")) /* -fprofile-generate counters are defined at the end */
+            continue;
+        size_t size = strlen(line);
+        memcpy(&text[len], line, size);
+        len += size;
+    }
+    fseek(state->asm_file, end, SEEK_SET);
+
+    /* call it like a call site would and exit with the result */
+    len += sprintf(&text[len], "section .text\n_start:\n");
+    for (size_t i = state->sym_count - 1; i > 0; i--) {
+        if (i - 1 >= target->arg_count)
+            len += sprintf(&text[len], "push %s\n", state->sym[i]);
+        else
+            len += sprintf(&text[len], "mov %s, %s\n", target->args[i - 1], state->sym[i]);
+    }
+    len += sprintf(&text[len], "call %s\n", callee);
+    if (state->flags & cminus_m64)
+        len += sprintf(&text[len], "mov rdi, rax\nmov eax, 60\nsyscall\n");
+    else
+        len += sprintf(&text[len], "mov ebx, eax\nmov eax, 1\nint 0x80\n");
+
+    cminus_emu_stats* stats = malloc(sizeof(cminus_emu_stats));
+    bool exited = cminus_emu_eval(text, len, CMINUS_EVAL_STEPS, stats);
+    const char* error = NULL;
+    if (!exited) error = stats->error ? stats->error : "it did not return";
+    else if (stats->data_stores) error = "it writes to globals";
+
+    if (error) {
+        fprintf(stderr, "Error: %s() in the initializer of %s can't be evaluated at compile time: %s\n", callee, state->sym[0], error);
+        exit(1);
+    }
+
+    int64_t val = (state->flags & cminus_m64) ? (int64_t)stats->exit_value : (int64_t)(int32_t)stats->exit_value;
+    free(stats);
+    free(text);
+    return val;
+}
+
+/* nasm data directive for a variable size */
+const char* cminus_data_directive(cminus_type type) {
+    switch (type.size) {
+        case 1: return "db";
+        case 2: return "dw";
+        case 8: return "dq";
+        default: return "dd";
+    }
+}
+
+/* nasm reserve directive for a variable size, for .bss */
+const char* cminus_reserve_directive(cminus_type type) {
+    switch (type.size) {
+        case 1: return "resb";
+        case 2: return "resw";
+        case 8: return "resq";
+        default: return "resd";
+    }
+}
+
+/* a global variable, zero initialized ones go to .bss so they take no space in the file */
+void cminus_write_global(cminus_state* state, char* name, cminus_type type, int64_t val) {
+    bool bss = (val == 0);
+    size_t* len = bss ? &state->bss_len : &state->data_len;
+    cminus_section(state, bss ? ".bss" : ".data");
+
+    /* keep globals naturally aligned, so they never straddle a cache line */
+    size_t align = cminus_type_align(type);
+    if (*len % align) {
+        cminus_write_line(state, "%s %lu", bss ? "alignb" : "align", align);
+        *len += align - *len % align;
+    }
+
+    if (type.record)
+        cminus_write_line(state, "%s: resb %lu", name, type.size);
+    else if (bss)
+        cminus_write_line(state, "%s: %s 1", name, cminus_reserve_directive(type));
+    else
+        cminus_write_line(state, "%s: %s %lli", name, cminus_data_directive(type), (long long)val);
+    *len += type.size;
+}
+
+/* index of a string literal in the pool, identical literals share one */
+size_t cminus_intern_string(const char* str, size_t len) {
+    for (size_t i = 0; i < cminus_string_count; i++)
+        if (cminus_strings[i].len == len && memcmp(&cminus_string_pool[cminus_strings[i].offset], str, len) == 0)
+            return i;
+
+    if (cminus_string_count == MAX_STRINGS || cminus_string_pool_len + len + 1 > CMINUS_STRING_POOL) {
+        fprintf(stderr, "Error: too many string literals\n");
+        exit(1);
+    }
+
+    cminus_strings[cminus_string_count].offset = cminus_string_pool_len;
+    cminus_strings[cminus_string_count].len = len;
+    memcpy(&cminus_string_pool[cminus_string_pool_len], str, len);
+    cminus_string_pool[cminus_string_pool_len + len] = '\0';
+    cminus_string_pool_len += len + 1;
+    return cminus_string_count++;
+}
+
+/* the longest literal that ends with literal i, so i can point into it, or i itself */
+size_t cminus_string_owner(size_t i) {
+    const char* str = &cminus_string_pool[cminus_strings[i].offset];
+    size_t len = cminus_strings[i].len, owner = i;
+
+    for (size_t j = 0; j < cminus_string_count; j++) {
+        size_t other = cminus_strings[j].len;
+        if (other <= len || other <= cminus_strings[owner].len)
+            continue;
+        if (memcmp(&cminus_string_pool[cminus_strings[j].offset + other - len], str, len) == 0)
+            owner = j;
+    }
+
+    return owner;
+}
+
+/* 
+    string literals go to .rodata, shared between processes
+    a literal that is the tail of a longer one (eg. "lo" and "hello") is a label into it
+*/
+/* the operands of a db for len bytes and a NUL, printable runs are quoted and the rest are written as numbers */
+size_t cminus_db_string(char* out, const char* str, size_t len) {
+    size_t n = 0;
+    bool quoted = false;
+    for (size_t k = 0; k < len; k++) {
+        unsigned char ch = str[k];
+        bool printable = (ch >= ' ' && ch < 127 && ch != '"');
+        if (printable && !quoted) n += sprintf(&out[n], "%s\"", k ? ", " : "");
+        else if (!printable && quoted) n += sprintf(&out[n], "\"");
+        if (printable) out[n++] = ch;
+        else n += sprintf(&out[n], "%s%u", k ? ", " : "", ch);
+        quoted = printable;
+    }
+    n += sprintf(&out[n], "%s%s0", quoted ? "\"" : "", len ? ", " : "");
+    return n;
+}
+
+void cminus_load_strings(cminus_state* state) {
+    if (cminus_string_count == 0)
+        return;
+
+    cminus_section(state, ".rodata");
+    for (size_t i = 0; i < cminus_string_count; i++) {
+        if (cminus_string_owner(i) != i)
+            continue;
+
+        char line[CMINUS_STRING_POOL * 4 + 64];
+        size_t n = snprintf(line, sizeof(line), "__cminus_str_%lu: db ", i);
+        cminus_db_string(&line[n], &cminus_string_pool[cminus_strings[i].offset], cminus_strings[i].len);
+        cminus_write_line(state, "%s", line);
+    }
+
+    for (size_t i = 0; i < cminus_string_count; i++) {
+        size_t owner = cminus_string_owner(i);
+        if (owner != i)
+            cminus_write_line(state, "__cminus_str_%lu equ __cminus_str_%lu + %lu", i, owner, cminus_strings[owner].len - cminus_strings[i].len);
+    }
+}
+
 void cminus_load_standard(cminus_state* state) {
     cminus_write_line(state, "sys_exit:");
     state->scope = 1;
-    cminus_write_line(state, "mov ebx, eax");
+    if ((state->flags & (cminus_profile_generate | cminus_sample)) || (state->runtime & cminus_rt_print)) {
+        cminus_write_line(state, "push %s", state->target->ax);
+        if (state->runtime & cminus_rt_print)
+            cminus_write_line(state, "call sys_flush");
+        if (state->flags & cminus_profile_generate)
+            cminus_write_line(state, "call __cminus_prof_dump");
+        if (state->flags & cminus_sample)
+            cminus_write_line(state, "call __cminus_pg_dump");
+        cminus_write_line(state, "pop %s", state->target->ax);
+    }
+    if (state->flags & cminus_m64) {
+        cminus_write_line(state, "mov edi, eax");
+        cminus_write_line(state, "mov eax, 60");
+        cminus_write_line(state, "syscall");
+    } else {
+        cminus_write_line(state, "mov ebx, eax");
+        cminus_write_line(state, "mov eax, 1");
+        cminus_write_line(state, "int  0x80");
+    }
+    state->scope = 0;
+}
+
+/* 
+    open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644), write each buffer and close it
+    the fd is kept in ebx (edi with -m64), which the syscalls leave alone
+*/
+void cminus_load_file_dump(cminus_state* state, const char* path, const char** bufs, const char** lens, size_t count) {
+    bool m64 = (state->flags & cminus_m64);
+    const char* fd = m64 ? "edi" : "ebx";
+    const char* syscall = m64 ? "syscall" : "int  0x80";
+
+    cminus_write_line(state, "mov eax, %i", m64 ? 2 : 5);
+    cminus_write_line(state, "mov %s, %s", fd, path);
+    cminus_write_line(state, "mov %s, 0x241", m64 ? "esi" : "ecx");
+    cminus_write_line(state, "mov edx, 420");
+    cminus_write_line(state, syscall);
+    cminus_write_line(state, "mov %s, eax", fd);
+
+    for (size_t i = 0; i < count; i++) {
+        cminus_write_line(state, "mov eax, %i", m64 ? 1 : 4);
+        cminus_write_line(state, "mov %s, %s", m64 ? "esi" : "ecx", bufs[i]);
+        cminus_write_line(state, "mov edx, %s", lens[i]);
+        cminus_write_line(state, syscall);
+    }
+
+    cminus_write_line(state, "mov eax, %i", m64 ? 3 : 6);
+    cminus_write_line(state, syscall);
+}
+
+/* the counter table and the code that writes it, sys_exit calls this with -fprofile-generate */
+void cminus_load_profile_dump(cminus_state* state) {
+    cminus_section(state, ".data");
+    /* the path comes from the command line, it may hold quotes */
+    size_t path_len = strlen(cminus_prof.path);
+    char* path = malloc(path_len * 4 + 8);
+    cminus_db_string(path, cminus_prof.path, path_len);
+    cminus_write_line(state, "__cminus_prof_path: db %s", path);
+    free(path);
+    cminus_write_line(state, "__cminus_prof:");
+
+    size_t len = 0;
+    for (size_t i = 0; i < cminus_prof_func_count; i++) {
+        cminus_write_line(state, "__cminus_prof_fn_%s: dd 0", cminus_prof_funcs[i]);
+        cminus_write_line(state, "db \"%s\", 0", cminus_prof_funcs[i]);
+        len += 4 + strlen(cminus_prof_funcs[i]) + 1;
+    }
+
+    char len_str[32];
+    snprintf(len_str, sizeof(len_str), "%lu", len);
+
+    cminus_section(state, ".text");
+    cminus_write_line(state, "__cminus_prof_dump:");
+    state->scope = 1;
+    cminus_load_file_dump(state, "__cminus_prof_path", (const char*[]){"__cminus_prof"}, (const char*[]){len_str}, 1);
+    cminus_write_line(state, "ret");
+    state->scope = 0;
+}
+
+/* 
+    -pg runtime: _start arms an ITIMER_PROF timer, the SIGPROF handler records the interrupted
+    instruction pointer into a ring buffer and sys_exit writes the word size, the number of samples taken and the buffer to cminus.pg
+*/
+void cminus_load_sampler_start(cminus_state* state) {
+    if (state->flags & cminus_m64) {
+        cminus_write_line(state, "mov eax, 13"); /* rt_sigaction(SIGPROF, &action, NULL, 8) */
+        cminus_write_line(state, "mov edi, 27");
+        cminus_write_line(state, "mov esi, __cminus_pg_action");
+        cminus_write_line(state, "xor edx, edx");
+        cminus_write_line(state, "mov r10d, 8");
+        cminus_write_line(state, "syscall");
+        cminus_write_line(state, "mov eax, 38"); /* setitimer(ITIMER_PROF, &timer, NULL) */
+        cminus_write_line(state, "mov edi, 2");
+        cminus_write_line(state, "mov esi, __cminus_pg_timer");
+        cminus_write_line(state, "xor edx, edx");
+        cminus_write_line(state, "syscall");
+    } else {
+        cminus_write_line(state, "mov eax, 174");
+        cminus_write_line(state, "mov ebx, 27");
+        cminus_write_line(state, "mov ecx, __cminus_pg_action");
+        cminus_write_line(state, "xor edx, edx");
+        cminus_write_line(state, "mov esi, 8");
+        cminus_write_line(state, "int  0x80");
+        cminus_write_line(state, "mov eax, 104");
+        cminus_write_line(state, "mov ebx, 2");
+        cminus_write_line(state, "mov ecx, __cminus_pg_timer");
+        cminus_write_line(state, "xor edx, edx");
+        cminus_write_line(state, "int  0x80");
+    }
+}
+
+void cminus_load_sampler(cminus_state* state) {
+    bool m64 = (state->flags & cminus_m64);
+    const char* word = m64 ? "dq" : "dd";
+
+    cminus_section(state, ".data");
+    cminus_write_line(state, "__cminus_pg_path: db \"cminus.pg\", 0");
+    cminus_write_line(state, "align 8");
+    cminus_write_line(state, "__cminus_pg_header: dd %lu", state->target->word);
+    cminus_write_line(state, "__cminus_pg_count: dd 0");
+    cminus_write_line(state, "__cminus_pg_pos: dd 0");
+    /* handler, SA_SIGINFO | SA_RESTART | SA_RESTORER, restorer and an empty mask */
+    cminus_write_line(state, "__cminus_pg_action: %s __cminus_pg_handler, 0x14000004, __cminus_pg_restorer, 0", word);
+    cminus_write_line(state, "%s 0", word);
+    /* every 1ms of cpu time */
+    cminus_write_line(state, "__cminus_pg_timer: %s 0, 1000, 0, 1000", word);
+    cminus_section(state, ".bss");
+    cminus_write_line(state, "alignb %i", CMINUS_CACHE_LINE);
+    cminus_write_line(state, "__cminus_pg_buf: res%c %i", m64 ? 'q' : 'd', CMINUS_PG_SAMPLES);
+
+    cminus_section(state, ".text");
+    /* the kernel restores every register on sigreturn, so the handler doesn't save any */
+    cminus_write_line(state, "__cminus_pg_handler:");
+    state->scope = 1;
+    if (m64) {
+        cminus_write_line(state, "mov rcx, [rdx + 168]"); /* ucontext->uc_mcontext.rip */
+        cminus_write_line(state, "mov eax, [__cminus_pg_pos]");
+        cminus_write_line(state, "mov [__cminus_pg_buf + rax*8], rcx");
+    } else {
+        cminus_write_line(state, "mov ecx, [esp + 12]");
+        cminus_write_line(state, "mov ecx, [ecx + 76]"); /* ucontext->uc_mcontext.eip */
+        cminus_write_line(state, "mov eax, [__cminus_pg_pos]");
+        cminus_write_line(state, "mov [__cminus_pg_buf + eax*4], ecx");
+    }
+    cminus_write_line(state, "inc eax");
+    cminus_write_line(state, "and eax, %i", CMINUS_PG_SAMPLES - 1);
+    cminus_write_line(state, "mov [__cminus_pg_pos], eax");
+    cminus_write_line(state, "inc dword [__cminus_pg_count]");
+    cminus_write_line(state, "ret");
+    state->scope = 0;
+
+    cminus_write_line(state, "__cminus_pg_restorer:");
+    state->scope = 1;
+    cminus_write_line(state, "mov eax, %i", m64 ? 15 : 173); /* rt_sigreturn */
+    cminus_write_line(state, m64 ? "syscall" : "int  0x80");
+    state->scope = 0;
+
+    char buf_len[32];
+    snprintf(buf_len, sizeof(buf_len), "%lu", CMINUS_PG_SAMPLES * state->target->word);
+
+    cminus_write_line(state, "__cminus_pg_dump:");
+    state->scope = 1;
+    cminus_load_file_dump(state, "__cminus_pg_path", (const char*[]){"__cminus_pg_header", "__cminus_pg_buf"}, (const char*[]){"8", buf_len}, 2);
+    cminus_write_line(state, "ret");
+    state->scope = 0;
+}
+
+cminus_runtime cminus_find_runtime(const char* name) {
+    if (strcmp(name, "sys_alloc") == 0 || strcmp(name, "sys_free") == 0 || strcmp(name, "sys_arena_reset") == 0)
+        return cminus_rt_heap;
+    if (strcmp(name, "sys_print") == 0 || strcmp(name, "sys_print_int") == 0 || strcmp(name, "sys_print_char") == 0 || strcmp(name, "sys_flush") == 0)
+        return cminus_rt_print;
+    return 0;
+}
+
+/* 
+    mmap(NULL, eax, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) and munmap(eax, ecx)
+    the i386 versions save the callee-saved registers the syscall args take
+*/
+void cminus_load_mmap(cminus_state* state) {
+    cminus_write_line(state, "__cminus_mmap:");
+    state->scope = 1;
+    if (state->flags & cminus_m64) {
+        cminus_write_line(state, "mov rsi, rax");
+        cminus_write_line(state, "xor edi, edi");
+        cminus_write_line(state, "mov edx, 3");
+        cminus_write_line(state, "mov r10d, 0x22");
+        cminus_write_line(state, "mov r8, -1");
+        cminus_write_line(state, "xor r9d, r9d");
+        cminus_write_line(state, "mov eax, 9");
+        cminus_write_line(state, "syscall");
+    } else {
+        cminus_write_line(state, "push ebx");
+        cminus_write_line(state, "push esi");
+        cminus_write_line(state, "push edi");
+        cminus_write_line(state, "push ebp");
+        cminus_write_line(state, "mov ecx, eax");
+        cminus_write_line(state, "xor ebx, ebx");
+        cminus_write_line(state, "mov edx, 3");
+        cminus_write_line(state, "mov esi, 0x22");
+        cminus_write_line(state, "mov edi, -1");
+        cminus_write_line(state, "xor ebp, ebp");
+        cminus_write_line(state, "mov eax, 192"); /* mmap2 */
+        cminus_write_line(state, "int  0x80");
+        cminus_write_line(state, "pop ebp");
+        cminus_write_line(state, "pop edi");
+        cminus_write_line(state, "pop esi");
+        cminus_write_line(state, "pop ebx");
+    }
+    cminus_write_line(state, "ret");
+    state->scope = 0;
+
+    cminus_write_line(state, "__cminus_munmap:");
+    state->scope = 1;
+    if (state->flags & cminus_m64) {
+        cminus_write_line(state, "mov rdi, rax");
+        cminus_write_line(state, "mov rsi, rcx");
+        cminus_write_line(state, "mov eax, 11");
+        cminus_write_line(state, "syscall");
+    } else {
+        cminus_write_line(state, "push ebx");
+        cminus_write_line(state, "mov ebx, eax");
+        cminus_write_line(state, "mov eax, 91");
+        cminus_write_line(state, "int  0x80");
+        cminus_write_line(state, "pop ebx");
+    }
+    cminus_write_line(state, "ret");
+    state->scope = 0;
+}
+
+/* 
+    sys_alloc(size), sys_free(ptr) and sys_arena_reset()
+    blocks are carved from 1MB chunks and start with a word holding their size class (16 << class bytes),
+    freed blocks go on a free list per class, which sys_alloc takes from before carving new ones,
+    so only a new chunk costs a syscall. blocks over 2048 bytes are mapped on their own and the header holds their size.
+    sys_arena_reset frees every small block at once by emptying the free lists and carving from the first chunk again,
+    the chunks are linked through their first word and reused
+*/
+void cminus_load_heap(cminus_state* state) {
+    bool m64 = (state->flags & cminus_m64);
+    const char* a = state->target->ax;
+    const char* c = m64 ? "rcx" : "ecx";
+    const char* d = m64 ? "rdx" : "edx";
+    size_t w = state->target->word;
+
+    cminus_section(state, ".bss");
+    cminus_write_line(state, "alignb %i", CMINUS_CACHE_LINE); /* the free lists and the heap pointers share a line */
+    cminus_write_line(state, "__cminus_free_lists: res%c %i", m64 ? 'q' : 'd', CMINUS_HEAP_CLASSES);
+    cminus_write_line(state, "__cminus_heap_first: res%c 1", m64 ? 'q' : 'd');
+    cminus_write_line(state, "__cminus_heap_cur: res%c 1", m64 ? 'q' : 'd');
+    cminus_write_line(state, "__cminus_heap_pos: res%c 1", m64 ? 'q' : 'd');
+    cminus_write_line(state, "__cminus_heap_end: res%c 1", m64 ? 'q' : 'd');
+
+    cminus_section(state, ".text");
+    cminus_load_mmap(state);
+
+    cminus_write_line(state, "sys_alloc:");
+    state->scope = 1;
+    if (m64) cminus_write_line(state, "mov rax, rdi");
+    cminus_write_line(state, "add %s, %lu", a, w);
+    cminus_write_line(state, "cmp %s, %i", a, 16 << (CMINUS_HEAP_CLASSES - 1));
+    cminus_write_line(state, "ja .large");
+    cminus_write_line(state, "xor ecx, ecx");
+    cminus_write_line(state, "mov edx, 16");
+    cminus_write_line(state, ".class:");
+    cminus_write_line(state, "cmp %s, %s", a, d);
+    cminus_write_line(state, "jbe .small");
+    cminus_write_line(state, "shl edx, 1");
+    cminus_write_line(state, "inc ecx");
+    cminus_write_line(state, "jmp .class");
+    cminus_write_line(state, ".small:");
+    cminus_write_line(state, "mov %s, [__cminus_free_lists + %s*%lu]", a, c, w);
+    cminus_write_line(state, "test %s, %s", a, a);
+    cminus_write_line(state, "jz .bump");
+    cminus_write_line(state, "mov %s, [%s]", d, a);
+    cminus_write_line(state, "mov [__cminus_free_lists + %s*%lu], %s", c, w, d);
+    cminus_write_line(state, "jmp .found");
+    cminus_write_line(state, ".bump:");
+    cminus_write_line(state, "mov %s, [__cminus_heap_pos]", a);
+    cminus_write_line(state, "lea %s, [%s + %s]", d, a, d);
+    cminus_write_line(state, "cmp %s, [__cminus_heap_end]", d);
+    cminus_write_line(state, "ja .refill");
+    cminus_write_line(state, "mov [__cminus_heap_pos], %s", d);
+    cminus_write_line(state, ".found:");
+    cminus_write_line(state, "mov [%s], %s", a, c);
+    cminus_write_line(state, "add %s, %lu", a, w);
+    cminus_write_line(state, "ret");
+    cminus_write_line(state, ".refill:");
+    cminus_write_line(state, "push %s", c);
+    cminus_write_line(state, "call __cminus_heap_chunk");
+    cminus_write_line(state, "pop %s", c);
+    cminus_write_line(state, "test %s, %s", a, a);
+    cminus_write_line(state, "jz .fail");
+    cminus_write_line(state, "mov edx, 16");
+    cminus_write_line(state, "shl edx, cl");
+    cminus_write_line(state, "jmp .bump");
+    cminus_write_line(state, ".large:");
+    cminus_write_line(state, "push %s", a);
+    cminus_write_line(state, "call __cminus_mmap");
+    cminus_write_line(state, "pop %s", c);
+    cminus_write_line(state, "cmp %s, -4096", a); /* -errno */
+    cminus_write_line(state, "ja .fail");
+    cminus_write_line(state, "mov [%s], %s", a, c);
+    cminus_write_line(state, "add %s, %lu", a, w);
+    cminus_write_line(state, "ret");
+    cminus_write_line(state, ".fail:");
+    cminus_write_line(state, "xor eax, eax");
+    cminus_write_line(state, "ret");
+    state->scope = 0;
+
+    cminus_write_line(state, "sys_free:");
+    state->scope = 1;
+    if (m64) cminus_write_line(state, "mov rax, rdi");
+    cminus_write_line(state, "test %s, %s", a, a);
+    cminus_write_line(state, "jz .done");
+    cminus_write_line(state, "sub %s, %lu", a, w);
+    cminus_write_line(state, "mov %s, [%s]", c, a);
+    cminus_write_line(state, "cmp %s, %i", c, CMINUS_HEAP_CLASSES);
+    cminus_write_line(state, "jae .large");
+    cminus_write_line(state, "mov %s, [__cminus_free_lists + %s*%lu]", d, c, w);
+    cminus_write_line(state, "mov [%s], %s", a, d);
+    cminus_write_line(state, "mov [__cminus_free_lists + %s*%lu], %s", c, w, a);
+    cminus_write_line(state, ".done:");
+    cminus_write_line(state, "ret");
+    cminus_write_line(state, ".large:");
+    cminus_write_line(state, "call __cminus_munmap");
+    cminus_write_line(state, "ret");
+    state->scope = 0;
+
+    cminus_write_line(state, "sys_arena_reset:");
+    state->scope = 1;
+    cminus_write_line(state, "mov %s, [__cminus_heap_first]", a);
+    cminus_write_line(state, "mov [__cminus_heap_cur], %s", a);
+    cminus_write_line(state, "test %s, %s", a, a);
+    cminus_write_line(state, "jz .done");
+    cminus_write_line(state, "lea %s, [%s + %lu]", c, a, w);
+    cminus_write_line(state, "mov [__cminus_heap_pos], %s", c);
+    cminus_write_line(state, "lea %s, [%s + %i]", c, a, CMINUS_HEAP_CHUNK);
+    cminus_write_line(state, "mov [__cminus_heap_end], %s", c);
+    cminus_write_line(state, "xor ecx, ecx");
+    for (size_t i = 0; i < CMINUS_HEAP_CLASSES; i++)
+        cminus_write_line(state, "mov [__cminus_free_lists + %lu], %s", i * w, c);
+    cminus_write_line(state, ".done:");
+    cminus_write_line(state, "ret");
+    state->scope = 0;
+
+    /* the next chunk, reused after an arena reset or mapped and linked to the last one, 0 if mmap fails */
+    cminus_write_line(state, "__cminus_heap_chunk:");
+    state->scope = 1;
+    cminus_write_line(state, "mov %s, [__cminus_heap_cur]", a);
+    cminus_write_line(state, "test %s, %s", a, a);
+    cminus_write_line(state, "jz .map");
+    cminus_write_line(state, "mov %s, [%s]", a, a);
+    cminus_write_line(state, "test %s, %s", a, a);
+    cminus_write_line(state, "jnz .use");
+    cminus_write_line(state, ".map:");
+    cminus_write_line(state, "mov eax, %i", CMINUS_HEAP_CHUNK);
+    cminus_write_line(state, "call __cminus_mmap");
+    cminus_write_line(state, "cmp %s, -4096", a);
+    cminus_write_line(state, "ja .fail");
+    cminus_write_line(state, "mov %s, [__cminus_heap_cur]", c);
+    cminus_write_line(state, "test %s, %s", c, c);
+    cminus_write_line(state, "jz .first");
+    cminus_write_line(state, "mov [%s], %s", c, a);
+    cminus_write_line(state, "jmp .use");
+    cminus_write_line(state, ".first:");
+    cminus_write_line(state, "mov [__cminus_heap_first], %s", a);
+    cminus_write_line(state, ".use:");
+    cminus_write_line(state, "mov [__cminus_heap_cur], %s", a);
+    cminus_write_line(state, "lea %s, [%s + %lu]", c, a, w);
+    cminus_write_line(state, "mov [__cminus_heap_pos], %s", c);
+    cminus_write_line(state, "lea %s, [%s + %i]", c, a, CMINUS_HEAP_CHUNK);
+    cminus_write_line(state, "mov [__cminus_heap_end], %s", c);
+    cminus_write_line(state, "ret");
+    cminus_write_line(state, ".fail:");
+    cminus_write_line(state, "xor eax, eax");
+    cminus_write_line(state, "ret");
+    state->scope = 0;
+}
+
+/* 
+    sys_print(str), sys_print_int(n), sys_print_char(c) and sys_flush()
+    output is appended to a buffer in .bss and only written when it is full, at a newline if stdout is a tty
+    (checked once with the TCGETS ioctl), on sys_flush or on sys_exit, so printing costs a syscall per 4KB, not per call
+*/
+void cminus_load_print(cminus_state* state) {
+    bool m64 = (state->flags & cminus_m64);
+    const char* a = state->target->ax;
+    const char* c = m64 ? "rcx" : "ecx";
+    const char* d = m64 ? "rdx" : "edx";
+
+    cminus_section(state, ".data");
+    cminus_write_line(state, "align 4");
+    cminus_write_line(state, "__cminus_ten: dd 10");
+    cminus_section(state, ".bss");
+    cminus_write_line(state, "alignb %i", CMINUS_CACHE_LINE);
+    cminus_write_line(state, "__cminus_out: resb %i", CMINUS_OUT_BUFFER);
+    cminus_write_line(state, "__cminus_out_len: resd 1");
+    cminus_write_line(state, "__cminus_out_tty: resd 1"); /* 0 until checked, then 1 for a tty and 2 otherwise */
+    cminus_write_line(state, "__cminus_termios: resb 64");
+    cminus_write_line(state, "__cminus_digits: resb 12"); /* the last byte stays 0 */
+
+    cminus_section(state, ".text");
+    cminus_write_line(state, "sys_flush:");
+    state->scope = 1;
+    cminus_write_line(state, "mov edx, [__cminus_out_len]");
+    cminus_write_line(state, "test edx, edx");
+    cminus_write_line(state, "jz .done");
+    /* write until everything is out, syscall clobbers rcx so -m64 keeps the pointer in rsi */
+    if (m64) {
+        cminus_write_line(state, "mov esi, __cminus_out");
+        cminus_write_line(state, ".write:");
+        cminus_write_line(state, "mov eax, 1");
+        cminus_write_line(state, "mov edi, 1");
+        cminus_write_line(state, "syscall");
+        cminus_write_line(state, "test eax, eax");
+        cminus_write_line(state, "jle .reset");
+        cminus_write_line(state, "add rsi, rax");
+        cminus_write_line(state, "sub edx, eax");
+        cminus_write_line(state, "jnz .write");
+    } else {
+        cminus_write_line(state, "push ebx");
+        cminus_write_line(state, "mov ecx, __cminus_out");
+        cminus_write_line(state, ".write:");
+        cminus_write_line(state, "mov eax, 4");
+        cminus_write_line(state, "mov ebx, 1");
+        cminus_write_line(state, "int  0x80");
+        cminus_write_line(state, "test eax, eax");
+        cminus_write_line(state, "jle .error");
+        cminus_write_line(state, "add ecx, eax");
+        cminus_write_line(state, "sub edx, eax");
+        cminus_write_line(state, "jnz .write");
+        cminus_write_line(state, ".error:");
+        cminus_write_line(state, "pop ebx");
+    }
+    cminus_write_line(state, ".reset:");
+    cminus_write_line(state, "mov dword [__cminus_out_len], 0");
+    cminus_write_line(state, ".done:");
+    cminus_write_line(state, "ret");
+    state->scope = 0;
+
+    /* called after a newline, flushes if stdout is a tty */
+    cminus_write_line(state, "__cminus_out_line:");
+    state->scope = 1;
+    cminus_write_line(state, "mov eax, [__cminus_out_tty]");
+    cminus_write_line(state, "test eax, eax");
+    cminus_write_line(state, "jnz .known");
+    if (m64) {
+        cminus_write_line(state, "mov eax, 16");
+        cminus_write_line(state, "mov edi, 1");
+        cminus_write_line(state, "mov esi, 0x5401");
+        cminus_write_line(state, "mov edx, __cminus_termios");
+        cminus_write_line(state, "syscall");
+    } else {
+        cminus_write_line(state, "push ebx");
+        cminus_write_line(state, "mov eax, 54");
+        cminus_write_line(state, "mov ebx, 1");
+        cminus_write_line(state, "mov ecx, 0x5401");
+        cminus_write_line(state, "mov edx, __cminus_termios");
+        cminus_write_line(state, "int  0x80");
+        cminus_write_line(state, "pop ebx");
+    }
+    cminus_write_line(state, "test eax, eax");
     cminus_write_line(state, "mov eax, 1");
-    cminus_write_line(state, "int  0x80");
+    cminus_write_line(state, "jz .store");
+    cminus_write_line(state, "mov eax, 2");
+    cminus_write_line(state, ".store:");
+    cminus_write_line(state, "mov [__cminus_out_tty], eax");
+    cminus_write_line(state, ".known:");
+    cminus_write_line(state, "cmp eax, 1");
+    cminus_write_line(state, "je sys_flush");
+    cminus_write_line(state, "ret");
+    state->scope = 0;
+
+    cminus_write_line(state, "sys_print_char:");
+    state->scope = 1;
+    if (m64) cminus_write_line(state, "mov eax, edi");
+    cminus_write_line(state, "mov ecx, [__cminus_out_len]");
+    cminus_write_line(state, "cmp ecx, %i", CMINUS_OUT_BUFFER);
+    cminus_write_line(state, "jb .room");
+    cminus_write_line(state, "push %s", a);
+    cminus_write_line(state, "call sys_flush");
+    cminus_write_line(state, "pop %s", a);
+    cminus_write_line(state, "xor ecx, ecx");
+    cminus_write_line(state, ".room:");
+    cminus_write_line(state, "mov [__cminus_out + %s], al", c);
+    cminus_write_line(state, "inc ecx");
+    cminus_write_line(state, "mov [__cminus_out_len], ecx");
+    cminus_write_line(state, "cmp al, 10");
+    cminus_write_line(state, "je __cminus_out_line");
+    cminus_write_line(state, "ret");
+    state->scope = 0;
+
+    cminus_write_line(state, "sys_print:");
+    state->scope = 1;
+    if (m64) cminus_write_line(state, "mov rax, rdi");
+    cminus_write_line(state, "mov %s, %s", d, a);
+    cminus_write_line(state, "mov ecx, [__cminus_out_len]");
+    cminus_write_line(state, ".next:");
+    cminus_write_line(state, "movzx eax, byte [%s]", d);
+    cminus_write_line(state, "test eax, eax");
+    cminus_write_line(state, "jz .end");
+    cminus_write_line(state, "cmp ecx, %i", CMINUS_OUT_BUFFER);
+    cminus_write_line(state, "jb .room");
+    cminus_write_line(state, "mov [__cminus_out_len], ecx");
+    cminus_write_line(state, "push %s", d);
+    cminus_write_line(state, "push %s", a);
+    cminus_write_line(state, "call sys_flush");
+    cminus_write_line(state, "pop %s", a);
+    cminus_write_line(state, "pop %s", d);
+    cminus_write_line(state, "xor ecx, ecx");
+    cminus_write_line(state, ".room:");
+    cminus_write_line(state, "mov [__cminus_out + %s], al", c);
+    cminus_write_line(state, "inc ecx");
+    cminus_write_line(state, "inc %s", d);
+    cminus_write_line(state, "cmp al, 10");
+    cminus_write_line(state, "jne .next");
+    cminus_write_line(state, "mov [__cminus_out_len], ecx");
+    cminus_write_line(state, "push %s", d);
+    cminus_write_line(state, "call __cminus_out_line");
+    cminus_write_line(state, "pop %s", d);
+    cminus_write_line(state, "mov ecx, [__cminus_out_len]");
+    cminus_write_line(state, "jmp .next");
+    cminus_write_line(state, ".end:");
+    cminus_write_line(state, "mov [__cminus_out_len], ecx");
+    cminus_write_line(state, "ret");
+    state->scope = 0;
+
+    /* digits are written backwards into __cminus_digits, then printed as a string */
+    cminus_write_line(state, "sys_print_int:");
+    state->scope = 1;
+    if (m64) cminus_write_line(state, "mov eax, edi");
+    cminus_write_line(state, "test eax, eax");
+    cminus_write_line(state, "jns .positive");
+    cminus_write_line(state, "push %s", a);
+    if (m64) cminus_write_line(state, "mov edi, '-'");
+    else cminus_write_line(state, "mov eax, '-'");
+    cminus_write_line(state, "call sys_print_char");
+    cminus_write_line(state, "pop %s", a);
+    cminus_write_line(state, "neg eax");
+    cminus_write_line(state, ".positive:");
+    cminus_write_line(state, "lea %s, [__cminus_digits + 11]", c);
+    cminus_write_line(state, ".digit:");
+    cminus_write_line(state, "xor edx, edx");
+    cminus_write_line(state, "div dword [__cminus_ten]");
+    cminus_write_line(state, "add edx, '0'");
+    cminus_write_line(state, "dec %s", c);
+    cminus_write_line(state, "mov [%s], dl", c);
+    cminus_write_line(state, "test eax, eax");
+    cminus_write_line(state, "jnz .digit");
+    cminus_write_line(state, "mov %s, %s", m64 ? "rdi" : "eax", c);
+    cminus_write_line(state, "jmp sys_print");
     state->scope = 0;
 }
 
-void cminus_parse(char* file, size_t file_len, char* string_buffer, size_t string_len, FILE* asm_file) {
+void cminus_parse(char* file, size_t file_len, char* string_buffer, size_t string_len, FILE* asm_file, cminus_flags flags) {
+    double start = cminus_stat.enabled ? cminus_stats_ms() : 0;
+    double others = cminus_stat.lex_ms + cminus_stat.sym_ms + cminus_stat.emit_ms;
     cminus_state state = {0};
+    /* the sym tables are global, clear anything left over from the previous file */
+    memset(cminus_sym_count, 0, sizeof(cminus_sym_count));
+    cminus_prof_func_count = 0;
+    cminus_string_count = 0;
+    cminus_string_pool_len = 0;
+    cminus_record_count = 0;
     state.asm_file = asm_file;
-    cminus_write_line(&state, "jmp _start");
-    cminus_load_standard(&state);
-    cminus_write_line(&state, "section .data");
+    state.flags = flags;
+    state.target = (flags & cminus_m64) ? &cminus_x86_64 : &cminus_i386;
+    if (flags & cminus_m64)
+        cminus_write_line(&state, "bits 64");
+    cminus_write_line(&state, "global _start");
 
     stb_lexer lex;
     stb_c_lexer_init(&lex, file, file + file_len, string_buffer, string_len);
-    while (stb_c_lexer_get_token(&lex)) {
+    state.line = 1;
+    state.line_pos = file;
+    while (cminus_lex(&lex, false)) {
         if (lex.token == CLEX_parse_error) {
             fprintf(stderr, "stb_c_lexer.h: fatal parse error\n");
             break;
         }
 
         state.lexer = &lex;
+        if (flags & cminus_debug)
+            cminus_track_line(&state);
         cminus_handle_token(&state);
         
         stb_lexer next = lex;
-        stb_c_lexer_get_token(&next);
+        cminus_lex(&next, true);
         state.next = next;
         state.prev = lex;
     }
 
+    cminus_section(&state, ".text");
     cminus_write_line(&state, "\n_start:");
     state.scope = 1;
+    if (flags & cminus_sample)
+        cminus_load_sampler_start(&state);
     cminus_write_line(&state, "call main");
     cminus_write_line(&state, "mov eax, 0");
     cminus_write_line(&state, "call sys_exit");
     state.scope = 0;
+
+    cminus_load_strings(&state);
+    if (flags & cminus_profile_generate)
+        cminus_load_profile_dump(&state);
+    if (flags & cminus_sample)
+        cminus_load_sampler(&state);
+    /* emitted last, once the runtime sys_exit has to flush is known */
+    cminus_section(&state, ".text");
+    cminus_load_standard(&state);
+    if (state.runtime & cminus_rt_heap)
+        cminus_load_heap(&state);
+    if (state.runtime & cminus_rt_print)
+        cminus_load_print(&state);
+
+    /* what is left over is the parser itself */
+    if (cminus_stat.enabled)
+        cminus_stat.parse_ms += (cminus_stats_ms() - start) - (cminus_stat.lex_ms + cminus_stat.sym_ms + cminus_stat.emit_ms - others);
 }
 
 void cminus_handle_keyword(cminus_state* state, bool func) {
     stb_lexer* lexer = state->lexer;
     switch (lexer->keyword) {
         /* ctypes */
-        case CLEX_long: case CLEX_const: case CLEX_signed: case CLEX_static: case CLEX_unsigned: case CLEX_extern: case CLEX_char: case CLEX_double: case CLEX_float: case CLEX_short: case CLEX_int: case CLEX_void:
+        case CLEX_char: state->var_type.size = 1; state->type = cminus_declare; break;
+        case CLEX_short: state->var_type.size = 2; state->type = cminus_declare; break;
+        case CLEX_int: 
+            if (state->var_type.size == 0) state->var_type.size = 4;
+            state->type = cminus_declare; 
+            break;
+        case CLEX_long: /* long long is 64bit */
+            state->var_type.size = (state->var_type.size == 4) ? 8 : 4;
+            state->type = cminus_declare;
+            break;
+        case CLEX_unsigned: state->var_type.is_unsigned = true; state->type = cminus_declare; break;
+        case CLEX_const: case CLEX_signed: case CLEX_static: case CLEX_extern: case CLEX_double: case CLEX_float: case CLEX_void:
             state->type = cminus_declare; break;
         case CLEX_do: printf("warning: ignored token: do\n"); break;
         case CLEX_case: printf("warning: ignored token: case\n"); break;
@@ -196,9 +1862,12 @@ void cminus_handle_keyword(cminus_state* state, bool func) {
         case CLEX_else: printf("warning: ignored token: else\n"); break;
         case CLEX_sizeof: printf("warning: ignored token: sizeof\n"); break;
         case CLEX_switch: printf("warning: ignored token: switch\n"); break;
-        case CLEX_struct: printf("warning: ignored token: struct\n"); break;
+        case CLEX_struct: case CLEX_union:
+            state->type = cminus_declare | cminus_aggregate;
+            state->record_union = (lexer->keyword == CLEX_union);
+            state->record_name[0] = '\0';
+            break;
         case CLEX_enum: printf("warning: ignored token: enum\n"); break;
-        case CLEX_union: printf("warning: ignored token: union\n"); break;
         case CLEX_typedef: printf("warning: ignored token: typedef\n"); break;
         default: printf("unhandled & warning: ignored token: %s\n", lexer->string);  break;
     }
@@ -210,8 +1879,44 @@ void cminus_handle_token(cminus_state* state) {
     stb_lexer* lexer = state->lexer;
     switch (lexer->token) {
         case CLEX_id: 
+            /* the first name after struct or union names the record */
+            if ((state->type & cminus_aggregate) && state->record_name[0] == '\0' && !state->defined && !(state->type & (cminus_var | cminus_set))) {
+                memcpy(state->record_name, lexer->string, MAX_SYM_NAME);
+                break;
+            }
+
+            /* p.x, the member is appended to the name it belongs to */
+            if (state->member) {
+                state->member = false;
+                size_t len = strlen(state->rvalue);
+                snprintf(&state->rvalue[len], MAX_SYM_NAME - len, ".%s", lexer->string);
+
+                char* name = NULL;
+                if (state->type & cminus_func) name = state->sym[state->sym_count - 1];
+                else if (!(state->type & cminus_var) && !(state->type & cminus_set)) name = state->sym[0];
+                if (name) {
+                    len = strlen(name);
+                    snprintf(&name[len], MAX_SYM_NAME - len, ".%s", lexer->string);
+                }
+                break;
+            }
+
+            memcpy(state->rvalue, lexer->string, MAX_SYM_NAME);
+            /* a parameter of a function being defined takes the type parsed since the previous one */
+            if ((state->type & cminus_func) && (state->type & cminus_declare) && !(state->type & (cminus_var | cminus_set))) {
+                if (state->type & cminus_aggregate) {
+                    fprintf(stderr, "Error: %s: struct and union parameters are not supported\n", lexer->string);
+                    exit(1);
+                }
+
+                state->sym_types[state->sym_count] = state->var_type;
+                if (state->sym_types[state->sym_count].size == 0) state->sym_types[state->sym_count].size = 4;
+                state->var_type = (cminus_type){0};
+            }
+
             if (state->type & cminus_func) {
-                memcpy(state->sym[state->sym_count], lexer->string, 255);
+                snprintf(state->sym[state->sym_count], MAX_SYM_NAME, "%s%s", state->address ? "&" : "", lexer->string);
+                state->address = false;
                 state->sym_count++;
                 break;
             }
@@ -220,6 +1925,14 @@ void cminus_handle_token(cminus_state* state) {
             if (!(state->type & cminus_var) && !(state->type & cminus_set))
                 memcpy(state->sym[0], lexer->string, 255);
             break;
+        case '.':
+            if (state->prev.token == CLEX_id)
+                state->member = true;
+            break;
+        case '&':
+            if (state->type & cminus_func)
+                state->address = true;
+            break;
         case CLEX_keyword:
             cminus_handle_keyword(state, state->type & cminus_func);
             break;
@@ -245,7 +1958,21 @@ void cminus_handle_token(cminus_state* state) {
         case CLEX_shleq: printf("warning: ignored token: <<=\n"); break;
         case CLEX_shreq: printf("warning: ignored token: >>=\n"); break;
         case CLEX_eqarrow: printf("warning: ignored token: =>\n"); break;
-        case CLEX_dqstring: printf("warning: ignored token: \"%s\"\n", lexer->string); break;
+        case CLEX_dqstring:
+            if ((state->type & cminus_func) && state->sym_count == 1 && strcmp(state->sym[0], "asm") == 0) {
+                cminus_load_asm(state, lexer->string);
+                break;
+            }
+
+            /* string args are passed as the address of the literal in the pool */
+            if (state->type & cminus_func) {
+                size_t index = cminus_intern_string(lexer->string, lexer->string_len);
+                snprintf(state->sym[state->sym_count], MAX_SYM_NAME, "__cminus_str_%lu", index);
+                state->sym_count++;
+                break;
+            }
+            printf("warning: ignored token: \"%s\"\n", lexer->string); 
+            break;
         case CLEX_sqstring: printf("warning: ignored token: '\"%s\"'\n", lexer->string); break;
         case CLEX_charlit:
         case CLEX_intlit:
@@ -253,6 +1980,10 @@ void cminus_handle_token(cminus_state* state) {
             if (state->type & cminus_func) {
                 size_t size = (lexer->where_lastchar - lexer->where_firstchar) + 1;
                 memcpy(state->sym[state->sym_count], lexer->where_firstchar, size);
+                state->sym[state->sym_count][size] = '\0';
+                /* nasm doesn't know escapes like '\n' in quotes, pass the value */
+                if (lexer->token == CLEX_charlit)
+                    snprintf(state->sym[state->sym_count], MAX_SYM_NAME, "%ld", lexer->int_number);
                 state->sym_count++;
                 break;
             }
@@ -267,122 +1998,276 @@ void cminus_handle_token(cminus_state* state) {
             break;
         case '(': 
             if (state->prev.token == CLEX_id) {
+                /* sym[0] is the variable being assigned, the result of the call is stored to it at ';' */
+                if (state->type & (cminus_var | cminus_set))
+                    memcpy(state->callee, state->prev.string, MAX_SYM_NAME);
+                else if (state->type & cminus_declare) /* the return type, the parameters have their own */
+                    state->var_type = (cminus_type){0};
                 state->type |= cminus_func;
                 state->sym_count++;
             }
             break;
         case ')': 
-            if (state->type & cminus_func && !(state->type & cminus_define) &&  !(state->type & cminus_declare)) {
+            if (state->type & cminus_func && ((!(state->type & cminus_define) &&  !(state->type & cminus_declare)) || (state->type & cminus_var))) {
+                char* callee = (state->type & (cminus_var | cminus_set)) ? state->callee : state->sym[0];
+                /* global initializers can't run code, the call is evaluated now */
+                if (state->scope == 0 && (state->type & cminus_var)) {
+                    state->folded_value = cminus_eval_call(state, callee);
+                    state->folded = true;
+                    state->sym_count = 0;
+                    state->type &= ~cminus_func;
+                    break;
+                }
+
+                if (strncmp(callee, "__builtin_", 10) == 0 || strcmp(callee, "asm") == 0) {
+                    if (callee[0] == '_') cminus_load_builtin(state, callee);
+                    state->sym_count = 0;
+                    state->type &= ~cminus_func;
+                    break;
+                }
+
                 if (state->sym_count > 1) {
                     cminus_write_line(state, "");
                     cminus_write_line(state, "; load args for call");
                 }
 
                 for (size_t i = state->sym_count - 1; i > 0; i--) {
-                    if ((state->sym[i][0] >= '0' && state->sym[i][0] <= '9') || state->sym[i][0] == '\'')
+                    if ((state->sym[i][0] >= '0' && state->sym[i][0] <= '9') || state->sym[i][0] == '\'' || strncmp(state->sym[i], "__cminus_str_", 13) == 0)
                         cminus_write_line(state, "mov eax, %s", state->sym[i]);
+                    else if (state->sym[i][0] == '&')
+                        cminus_load_address(state, state->sym[i], state->target->ax);
                     else {
-                        cminus_sym* sym = cminus_find_sym(state->sym[i], state->scope);   
-                        if (sym->scope)
-                            cminus_write_line(state, "mov eax, [esp + %li]", sym->index* 4);
-                        else
-                            cminus_write_line(state, "mov eax, [%s]", sym->sym);
+                        cminus_sym* sym = cminus_lookup(state, state->sym[i]);
+                        cminus_load_sym(state, sym, (cminus_type){state->target->word, false});
                     }
                     
-                    switch(i - 1) {
-                        case 0: break; /* eax == eax*/
-                        case 1: cminus_write_line(state, "mov edx, eax"); break;
-                        default:
-                            cminus_write_line(state, "push eax");
-                            break;
-                    }
+                    const cminus_target* target = state->target;
+                    if (i - 1 >= target->arg_count) {
+                        cminus_write_line(state, "push %s", target->ax);
+                        state->depth++;
+                    } else if (strcmp(target->args[i - 1], target->ax)) 
+                        cminus_write_line(state, "mov %s, %s", target->args[i - 1], target->ax);
                 }
 
-                cminus_write_line(state, "call %s", state->sym[0]);
-                for (size_t i = 3; i < state->sym_count; i++)
-                    cminus_write_line(state, "pop eax");
+                cminus_write_line(state, "call %s", callee);
+                state->runtime |= cminus_find_runtime(callee);
+                if (state->sym_count > state->target->arg_count + 1) {
+                    size_t pushed = state->sym_count - state->target->arg_count - 1;
+                    cminus_write_line(state, "add %s, %lu", state->target->sp, pushed * state->target->word);
+                    state->depth -= pushed;
+                }
                 state->sym_count = 0;
+                /* the result is in eax, ';' stores it like any other rvalue, a 64bit variable takes it sign extended on i386 */
+                if (!(state->flags & cminus_m64) && (state->type & (cminus_var | cminus_set))) {
+                    cminus_type dest = (state->type & cminus_var) ? state->var_type : cminus_lookup(state, state->sym[0])->type;
+                    if (dest.size == 8)
+                        cminus_write_line(state, "cdq");
+                }
+                state->type &= ~cminus_func;
             }
             break;
         case '{':
+            /* a struct or union body, its declarations become fields */
+            if ((state->type & cminus_aggregate) && !(state->type & cminus_func)) {
+                if (cminus_record_count == MAX_RECORDS) {
+                    fprintf(stderr, "Error: too many structs\n");
+                    exit(1);
+                }
+
+                cminus_record* record = &cminus_records[cminus_record_count++];
+                memset(record, 0, sizeof(*record));
+                memcpy(record->name, state->record_name, MAX_SYM_NAME);
+                record->is_union = state->record_union;
+                state->defining = cminus_record_count;
+                state->type = 0;
+                state->var_type = (cminus_type){0};
+                break;
+            }
+
             if ((state->type & cminus_declare)) {
                 state->type |= cminus_func;
+                cminus_section(state, cminus_func_section(state, state->sym[0]));
+                /* a typed, sized symbol so perf and gdb can find the function of an address */
+                if (state->flags & cminus_debug)
+                    cminus_write_line(state, "global %s:function (%s.end - %s)", state->sym[0], state->sym[0], state->sym[0]);
                 cminus_write_line(state, "%s:", (char*)state->sym);
                 state->scope++;
-                cminus_write_line(state, "; load stack frame");
-                cminus_write_line(state, "push ebp");
-                cminus_write_line(state, "mov ebp, esp");
+                state->depth = 0;
+                if ((state->flags & cminus_profile_generate) && cminus_prof_func_count < MAX_SYMS) {
+                    memcpy(cminus_prof_funcs[cminus_prof_func_count++], state->sym[0], MAX_SYM_NAME);
+                    cminus_write_line(state, "inc dword [__cminus_prof_fn_%s]", state->sym[0]);
+                }
+                if (state->flags & cminus_frame_pointer) {
+                    cminus_write_line(state, "; load stack frame");
+                    cminus_write_line(state, "push %s", state->target->bp);
+                    cminus_write_line(state, "mov %s, %s", state->target->bp, state->target->sp);
+                    state->depth++;
+                }
             } else state->scope++;
 
             state->type = 0;
+            state->var_type = (cminus_type){0};
             if (state->sym_count > 1) {
                 cminus_write_line(state, "");
                 cminus_write_line(state, "; load args into this stack frame");
             }
 
+            /* args arrive as whole words and are spilled as they are, loads narrow them to the declared type */
             for (size_t i = 1; i < state->sym_count; i++) {
-                cminus_push_sym(state->sym[i], state->stack_len[state->scope], state->scope);
-                state->stack_len[state->scope]++;
-                switch(i) {
-                    case 0: cminus_write_line(state, "push eax");  break;
-                    case 1: cminus_write_line(state, "push edx"); break;
-                    default: /* load the rest from the stack */
-                        cminus_write_line(state, "mov eax, [ebp - %li]", (i - 1) * 4);
-                        cminus_write_line(state, "push eax");
-                        break;
+                const cminus_target* target = state->target;
+                const char* reg = target->ax;
+                cminus_type type = state->sym_types[i];
+                if (i - 1 < target->arg_count) {
+                    reg = target->args[i - 1];
+                } else {
+                    /* load the rest from the caller's stack, right above the return address */
+                    cminus_write_line(state, "mov %s, [%s + %li]", target->ax, target->sp, (state->depth + 1 + (i - 1 - target->arg_count)) * target->word);
+                }
+
+                /* a 64bit parameter on i386 takes two slots like a local, the high half is extended from the 32bit arg */
+                if (type.size == 8 && !(state->flags & cminus_m64)) {
+                    if (type.is_unsigned) {
+                        cminus_write_line(state, "push 0");
+                    } else {
+                        cminus_write_line(state, "push %s", reg);
+                        cminus_write_line(state, "sar dword [esp], 31");
+                    }
+                    state->stack_len[state->scope]++;
+                    state->depth++;
                 }
+                cminus_write_line(state, "push %s", reg);
+                state->stack_len[state->scope]++;
+                state->depth++;
+
+                cminus_push_sym(state->sym[i], state->depth - 1, state->scope, type);
             }
             cminus_write_line(state, "");
 
             state->sym_count = 0;
             break;
         case '}':
+            /* end of a record body, struct point { ... } p; can still declare a variable */
+            if (state->defining) {
+                cminus_layout_record(state, &cminus_records[state->defining - 1]);
+                memcpy(state->record_name, cminus_records[state->defining - 1].name, MAX_SYM_NAME);
+                state->record_union = cminus_records[state->defining - 1].is_union;
+                state->defined = state->defining;
+                state->defining = 0;
+                state->type = cminus_declare | cminus_aggregate;
+                state->sym[0][0] = '\0';
+                break;
+            }
+
             cminus_write_line(state, "");
-            cminus_write_line(state, "; clear stack frame");
             size_t stackLength = state->stack_len[state->scope];
-            for (size_t i = 0; i < stackLength; i++) {
-                cminus_write_line(state, "pop eax");
-                cminus_pop_sym(state->scope);
+            if (stackLength) {
+                cminus_write_line(state, "; clear stack frame");
+                cminus_write_line(state, "add %s, %lu", state->target->sp, stackLength * state->target->word);
             }
 
+            /* 64bit locals take two slots, so there may be fewer syms than slots */
+            for (size_t i = cminus_sym_count[state->scope]; i > 0; i--)
+                cminus_pop_sym(state->scope);
+
             state->stack_len[state->scope] = 0;
-            
-            cminus_write_line(state, "");
-            cminus_write_line(state, "; reset stack frame");
-            cminus_write_line(state, "pop ebp");
-            cminus_write_line(state, "ret");
+            state->depth -= stackLength;
+
+            /* only the function's own scope returns */
+            if (state->scope == 1) {
+                if (state->flags & cminus_frame_pointer) {
+                    cminus_write_line(state, "");
+                    cminus_write_line(state, "; reset stack frame");
+                    cminus_write_line(state, "pop %s", state->target->bp);
+                }
+                cminus_write_line(state, "ret");
+                if (state->flags & cminus_debug)
+                    cminus_write_line(state, ".end:");
+            }
+
             state->scope--;
             if ((state->type & cminus_define) && (state->type & cminus_func))
                 state->type = 0;
             break;
         case ';': 
-            if ((state->type & cminus_declare) && !(state->type & cminus_func)) {    
-                int8_t val = cminus_load_rvalue(state, "eax");
+            if ((state->type & cminus_aggregate) && !(state->type & cminus_func) && state->sym[0][0]) {
+                /* an anonymous record can only be found by its index */
+                cminus_record* record = state->defined ? &cminus_records[state->defined - 1] : cminus_find_record(state->record_name, state->record_union);
+                state->var_type = (cminus_type){record->size, false, (size_t)(record - cminus_records) + 1};
+            }
+
+            if (state->defining && (state->type & cminus_declare)) {
+                cminus_record* record = &cminus_records[state->defining - 1];
+                if (record->field_count == MAX_FIELDS) {
+                    fprintf(stderr, "Error: too many fields in %s\n", record->name);
+                    exit(1);
+                }
+
+                cminus_field* field = &record->fields[record->field_count++];
+                memcpy(field->name, state->sym[0], MAX_SYM_NAME);
+                field->type = state->var_type;
+                if (field->type.size == 0) field->type.size = 4;
+            } else if ((state->type & cminus_declare) && !(state->type & cminus_func) && state->sym[0][0] == '\0') {
+                /* struct point { ... }; declares no variable */
+            } else if ((state->type & cminus_declare) && !(state->type & cminus_func) && state->var_type.record) {
+                cminus_type type = state->var_type;
+                if (state->scope) {
+                    /* uninitialized, like any C local */
+                    size_t slots = (type.size + state->target->word - 1) / state->target->word;
+                    cminus_write_line(state, "sub %s, %lu", state->target->sp, slots * state->target->word);
+                    state->stack_len[state->scope] += slots;
+                    state->depth += slots;
+                } else {
+                    cminus_write_global(state, state->sym[0], type, 0);
+                }
+
+                /* the lowest slot, pushed last, holds the start of the struct */
+                cminus_push_sym(state->sym[0], state->scope ? state->depth - 1 : 0, state->scope, type);
+            } else if ((state->type & cminus_declare) && !(state->type & cminus_func)) {    
+                cminus_type type = state->var_type;
+                if (type.size == 0) type.size = 4;
 
-                if (state->scope)
+                int64_t val = cminus_load_rvalue(state, "eax", type);
+                if (state->folded)
+                    val = cminus_truncate(state->folded_value, type);
+
+                /* locals live in word sized stack slots, 64bit locals take two on i386 */
+                if (state->scope && type.size == 8 && !(state->flags & cminus_m64)) {
+                    cminus_write_line(state, "push edx");
                     cminus_write_line(state, "push eax");
-                else
-                    cminus_write_line(state, "%s: dd %i", state->sym[0], val);
+                    state->stack_len[state->scope] += 2;
+                    state->depth += 2;
+                }
+                else if (state->scope) {
+                    cminus_write_line(state, "push %s", state->target->ax);
+                    state->stack_len[state->scope]++;
+                    state->depth++;
+                }
+                else {
+                    cminus_write_global(state, state->sym[0], type, val);
+                }
                 
-                cminus_push_sym(state->sym[0], state->stack_len[state->scope], state->scope);
-                state->stack_len[state->scope]++;
+                /* the low half of a 64bit local is pushed last */
+                cminus_push_sym(state->sym[0], state->scope ? state->depth - 1 : 0, state->scope, type);
+                /* the slot was pushed from eax, narrow ones may have been extended with the initializer's signedness */
+                if (state->scope && type.size >= 4)
+                    cminus_ax_hold(state, &cminus_syms[state->scope][cminus_sym_count[state->scope] - 1]);
             }  else if ((state->type & cminus_set)) {
                 if (state->scope == 0) {
                     fprintf(stderr, "error: syntax error\n");
                     exit(1);
                 }
 
-                cminus_load_rvalue(state, "eax");
-                printf("%s\n", state->sym[0]);
-                cminus_sym* sym = cminus_find_sym(state->sym[0], state->scope);
-
-                if (sym->scope)
-                    cminus_write_line(state, "mov [esp + %li], eax", sym->index* 4);
-                else
-                    cminus_write_line(state, "mov [%s], eax", sym->sym);
+                /* copied, loading a member rvalue reuses cminus_member */
+                cminus_sym sym = *cminus_lookup(state, state->sym[0]);
+                cminus_load_rvalue(state, "eax", sym.type);
+                cminus_store_sym(state, &sym);
             }
 
             state->type = 0; 
+            state->var_type = (cminus_type){0};
+            state->record_name[0] = '\0';
+            state->defined = 0;
+            state->folded = false;
             break;
         case CLEX_eof: break;
         default:
@@ -707,7 +707,10 @@ int stb_c_lexer_get_token(stb_lexer *lexer)
                return stb__clex_token(lexer, CLEX_parse_error, start,start);
             if (p == lexer->eof || *p != '\'')
                return stb__clex_token(lexer, CLEX_parse_error, start,p);
-            return stb__clex_token(lexer, CLEX_charlit, start, p+1);
+            /* colleagueriley */
+            /* the closing quote is the last character of the token, not the one after it */
+            return stb__clex_token(lexer, CLEX_charlit, start, p);
+            /* end of colleagueriley */
          })
          goto single_char;
 
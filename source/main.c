@@ -1,63 +1,290 @@
+#define _GNU_SOURCE /* struct ucred */
 #define CMINUS_PARSER_IMPLEMENTATION
 #include <cminus_parser.h>
 
+#define CMINUS_EMU_IMPLEMENTATION
+#include <cminus_emu.h>
+
+#include <sys/stat.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <elf.h>
+#endif
+
+#define CMINUS_VERSION "0.1"
+
+/* cached objects are keyed by this, so rebuilding the compiler invalidates them */
+const char compiler_id[] = CMINUS_VERSION " " __DATE__ " " __TIME__;
+
 typedef CMINUS_ENUM(uint32_t, programArgs) {
     cminus_asmOnly = CMINUS_BIT(0),
+    cminus_verbose = CMINUS_BIT(1),
+    cminus_noCache = CMINUS_BIT(2),
+    cminus_timing = CMINUS_BIT(3), /* print the time spent in each phase */
+    cminus_trace = CMINUS_BIT(4), /* run the output in the emulator instead of assembling it */
+    cminus_showStats = CMINUS_BIT(5), /* print per phase times and counters */
+    cminus_statsJson = CMINUS_BIT(6), /* print them as json */
 };
 
 char string_buffer[0x10000];
+char cache_dir[0x1000];
+char asm_path[0x1000] = "out.asm"; /* -S always writes out.asm */
+cminus_emu_stats emu_stats;
+double io_ms, assemble_ms, link_ms; /* the phases outside of the parser, for --stats */
 
-int main(int argc, char **argv) {
-    programArgs args = 0;
-    if (argc < 1) {
-        fprintf(stderr, "%s: fatal error: no input files\n", argv[0]);  
-        return 1;  
+double time_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+/* FNV-1a, used to key the object cache */
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= ((const uint8_t*)data)[i];
+        hash *= 0x100000001b3;
     }
 
-    for (size_t index = 1; index < argc; index++) {
-        if (argv[index][0] == '-') {
-            if (*((uint32_t*)argv[index]) == *((uint32_t*)"-S"))
-                args |= cminus_asmOnly;
-            continue;
-        }
+    return hash;
+}
 
-        FILE* file = fopen(argv[index], "rb");
-        fseek(file, 0L, SEEK_END);
-        size_t size = ftell(file);
-        char* text = (char*)malloc(size);
-        fseek(file, 0L, SEEK_SET);
+/* 
+    the copy is written next to dst and renamed over it once it is complete,
+    so a concurrent compile never reads half a file and a failed write never leaves a truncated one
+*/
+bool copy_file(const char* src, const char* dst) {
+    FILE* in = fopen(src, "rb");
+    if (in == NULL)
+        return false;
 
-        if (fread(text, 1, size, file) == 0) {
-            fprintf(stderr, "Error opening file: %s\n", argv[index]);
-            free(text);
-            fclose(file);
-            return 1;
-        }
+    char tmp[4096];
+    #ifdef _WIN32
+    snprintf(tmp, sizeof(tmp), "%s.tmp", dst);
+    #else
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", dst, (int)getpid());
+    #endif
 
-        fclose(file);
+    FILE* out = fopen(tmp, "wb");
+    if (out == NULL) {
+        fclose(in);
+        return false;
+    }
+
+    char buffer[0x1000];
+    size_t size;
+    bool ok = true;
+    while (ok && (size = fread(buffer, 1, sizeof(buffer), in)))
+        ok = (fwrite(buffer, 1, size, out) == size);
+    
+    ok = ok && !ferror(in);
+    fclose(in);
+    ok = (fclose(out) == 0) && ok;
+
+    #ifdef _WIN32
+    if (ok) remove(dst); /* rename doesn't replace files on windows */
+    #endif
+    if (!ok || rename(tmp, dst) != 0) {
+        remove(tmp);
+        return false;
+    }
+    return true;
+}
+
+/* $CMINUS_CACHE_DIR, or ~/.cache/cminus */
+bool load_cache_dir(void) {
+    char* dir = getenv("CMINUS_CACHE_DIR");
+    if (dir) {
+        snprintf(cache_dir, sizeof(cache_dir), "%s", dir);
+    } else {
+        char* home = getenv("HOME");
+        if (home == NULL)
+            return false;
+
+        snprintf(cache_dir, sizeof(cache_dir), "%s/.cache", home);
+        mkdir(cache_dir, 0755);
+        snprintf(cache_dir, sizeof(cache_dir), "%s/.cache/cminus", home);
+    }
+
+    mkdir(cache_dir, 0755);
+    struct stat info;
+    return stat(cache_dir, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+/* foo.c -> foo.o */
+void object_path(const char* source, char* out) {
+    strcpy(out, source);
+    out[strlen(out) - 1] = 'o';
+}
+
+/* run the assembly in the emulator and report what it executed */
+int trace_file(char* path, char* asm_file) {
+    FILE* file = fopen(asm_file, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", asm_file);
+        return 1;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    size_t size = ftell(file);
+    char* text = (char*)malloc(size);
+    fseek(file, 0L, SEEK_SET);
+    size = fread(text, 1, size, file);
+    fclose(file);
 
-        FILE* output = fopen("out.asm", "w+");
-        cminus_parse(text, size, string_buffer, sizeof(string_buffer), output);
+    bool exited = cminus_emu_run(text, size, 0, &emu_stats);
+    free(text);
+
+    printf("cminus: %s: ", path);
+    cminus_emu_report(&emu_stats, stdout);
+    return exited ? 0 : 1;
+}
+
+int compile_file(char* path, programArgs args, cminus_flags flags) {
+    double start = time_ms();
+    double io_start = start;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", path);
+        return 1;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    size_t size = ftell(file);
+    char* text = (char*)malloc(size);
+    fseek(file, 0L, SEEK_SET);
+
+    if (fread(text, 1, size, file) == 0) {
+        fprintf(stderr, "Error opening file: %s\n", path);
         free(text);
-        fclose(output);
-        
-        if (args & cminus_asmOnly)
-            continue;
-        
-        argv[index][strlen(argv[index]) - 1] = 'o';
-        sprintf(string_buffer, "nasm -f elf out.asm -o %s", argv[index]);
-        system(string_buffer);
+        fclose(file);
+        return 1;
+    }
+
+    fclose(file);
+    io_ms += time_ms() - io_start;
+
+    /* the object only depends on the source, the compiler and the flags */
+    char object[0x1000], cached[0x2000];
+    object_path(path, object);
+    
+    bool cache = !(args & (cminus_asmOnly | cminus_noCache | cminus_trace)) && load_cache_dir();
+    if (cache) {
+        uint64_t key = hash_bytes(0xcbf29ce484222325, compiler_id, sizeof(compiler_id));
+        key = hash_bytes(key, &flags, sizeof(flags));
+        if (flags & cminus_profile_generate)
+            key = hash_bytes(key, cminus_prof.path, strlen(cminus_prof.path));
+        if (flags & cminus_debug) /* the line info names the source */
+            key = hash_bytes(key, path, strlen(path));
+        if (flags & cminus_profile_use) {
+            key = hash_bytes(key, cminus_prof.names, cminus_prof.count * sizeof(cminus_prof.names[0]));
+            key = hash_bytes(key, cminus_prof.counts, cminus_prof.count * sizeof(cminus_prof.counts[0]));
+        }
+        key = hash_bytes(key, text, size);
+        snprintf(cached, sizeof(cached), "%s/%016llx.o", cache_dir, (unsigned long long)key);
+
+        if (copy_file(cached, object)) {
+            if (args & cminus_verbose)
+                printf("cminus: %s: reused cached object %s\n", path, cached);
+            free(text);
+            return 0;
+        }
     }
+
+    io_start = time_ms();
+    FILE* output = fopen((args & cminus_asmOnly) ? "out.asm" : asm_path, "w+");
+    io_ms += time_ms() - io_start;
+
+    cminus_debug_file = path;
+    cminus_parse(text, size, string_buffer, sizeof(string_buffer), output, flags);
+    free(text);
+
+    io_start = time_ms();
+    fclose(output);
+    double parsed = time_ms();
+    io_ms += parsed - io_start;
     
     if (args & cminus_asmOnly)
         return 0;
 
-    memcpy(string_buffer, "ld -m elf_i386 ", 16);
-    size_t i = 15;
+    if (args & cminus_trace)
+        return trace_file(path, asm_path);
+    
+    sprintf(string_buffer, "nasm -f %s%s %s -o %s", (flags & cminus_m64) ? "elf64" : "elf", (flags & cminus_debug) ? " -g -F dwarf" : "", asm_path, object);
+    int status = system(string_buffer);
+    assemble_ms += time_ms() - parsed;
+    if (status != 0)
+        return 1;
+
+    if (args & cminus_timing)
+        printf("cminus: %s: compile %.2f ms, assemble %.2f ms\n", path, parsed - start, time_ms() - parsed);
+
+    if (cache) {
+        bool stored = copy_file(object, cached);
+        if (args & cminus_verbose)
+            printf(stored ? "cminus: %s: compiled, cached as %s\n" : "cminus: %s: compiled, writing the cache entry %s failed\n", path, cached);
+    }
+    
+    return 0;
+}
+
+void parse_args(int argc, char **argv, programArgs* args, cminus_flags* flags) {
+    for (size_t index = 1; index < argc; index++) {
+        if (argv[index][0] == '-') {
+            if (strcmp(argv[index], "-S") == 0)
+                *args |= cminus_asmOnly;
+            else if (strcmp(argv[index], "-v") == 0)
+                *args |= cminus_verbose;
+            else if (strcmp(argv[index], "--trace") == 0)
+                *args |= cminus_trace;
+            else if (strcmp(argv[index], "--stats") == 0)
+                *args |= cminus_showStats;
+            else if (strcmp(argv[index], "--stats=json") == 0)
+                *args |= cminus_showStats | cminus_statsJson;
+            else if (strcmp(argv[index], "-fno-cache") == 0)
+                *args |= cminus_noCache;
+            else if (strcmp(argv[index], "-m64") == 0)
+                *flags |= cminus_m64;
+            else if (strcmp(argv[index], "-m32") == 0)
+                *flags &= ~cminus_m64;
+            else if (strcmp(argv[index], "-fno-omit-frame-pointer") == 0)
+                *flags |= cminus_frame_pointer;
+            else if (strcmp(argv[index], "-g") == 0)
+                *flags |= cminus_debug;
+            else if (strcmp(argv[index], "-pg") == 0)
+                *flags |= cminus_sample;
+            else if (strcmp(argv[index], "-freorder-fields") == 0)
+                *flags |= cminus_reorder_fields;
+            else if (strncmp(argv[index], "-fprofile-generate", 18) == 0) {
+                *flags |= cminus_profile_generate;
+                if (argv[index][18] == '=') cminus_prof.path = &argv[index][19];
+            } else if (strncmp(argv[index], "-fprofile-use", 13) == 0) {
+                *flags |= cminus_profile_use;
+                if (argv[index][13] == '=') cminus_prof.path = &argv[index][14];
+            }
+        }
+    }
+}
+
+int link_files(int argc, char **argv, programArgs args, cminus_flags flags) {
+    double start = time_ms();
+    size_t i = sprintf(string_buffer, "ld -m %s", (flags & cminus_m64) ? "elf_x86_64" : "elf_i386");
     for (size_t index = 1; index < argc; index++) {
-        size_t size = strlen(argv[index]);
-        strcpy(&string_buffer[i], argv[index]);
-        i += size;
+        if (argv[index][0] == '-')
+            continue;
+        
+        string_buffer[i++] = ' ';
+        object_path(argv[index], &string_buffer[i]);
+        i += strlen(&string_buffer[i]);
     }
     
     #ifdef _WIN32
@@ -73,5 +300,516 @@ int main(int argc, char **argv) {
     #else
     system(string_buffer);
     #endif
+
+    link_ms += time_ms() - start;
+    if (args & cminus_timing)
+        printf("cminus: link %.2f ms\n", time_ms() - start);
+    return 0;
+}
+
+/* -ftime-report style summary, written to stderr so it doesn't mix with --trace */
+void print_stats(programArgs args) {
+    cminus_stats* s = &cminus_stat;
+    double total = io_ms + s->lex_ms + s->parse_ms + s->sym_ms + s->emit_ms + assemble_ms + link_ms;
+    double avg_probes = s->find_sym_calls ? (double)s->find_sym_probes / s->find_sym_calls : 0;
+
+    if (args & cminus_statsJson) {
+        fprintf(stderr, "{\"io_ms\": %.3f, \"lex_ms\": %.3f, \"parse_ms\": %.3f, \"sym_ms\": %.3f, \"emit_ms\": %.3f, "
+                        "\"assemble_ms\": %.3f, \"link_ms\": %.3f, \"total_ms\": %.3f, "
+                        "\"tokens\": %zu, \"relexed\": %zu, \"find_sym_calls\": %zu, \"find_sym_probes\": %zu, "
+                        "\"find_sym_max_probes\": %zu, \"lines\": %zu, \"bytes\": %zu, \"loads_removed\": %zu}\n",
+                io_ms, s->lex_ms, s->parse_ms, s->sym_ms, s->emit_ms, assemble_ms, link_ms, total,
+                s->tokens, s->relexed, s->find_sym_calls, s->find_sym_probes, s->find_sym_max_probes, s->lines, s->bytes, s->loads_removed);
+        return;
+    }
+
+    #define CMINUS_STATS_ROW(name, ms) fprintf(stderr, "  %-12s %10.3f ms %5.1f%%\n", name, ms, total > 0 ? (ms) * 100 / total : 0)
+    fprintf(stderr, "cminus: time report\n");
+    CMINUS_STATS_ROW("file io", io_ms);
+    CMINUS_STATS_ROW("lexing", s->lex_ms);
+    CMINUS_STATS_ROW("parsing", s->parse_ms);
+    CMINUS_STATS_ROW("symbols", s->sym_ms);
+    CMINUS_STATS_ROW("emission", s->emit_ms);
+    CMINUS_STATS_ROW("assembly", assemble_ms);
+    CMINUS_STATS_ROW("linking", link_ms);
+    CMINUS_STATS_ROW("total", total);
+    #undef CMINUS_STATS_ROW
+
+    fprintf(stderr, "cminus: counters\n");
+    fprintf(stderr, "  %-12s %10zu (+%zu lookahead re-lexes)\n", "tokens", s->tokens, s->relexed);
+    fprintf(stderr, "  %-12s %10zu (%.2f probes avg, %zu max)\n", "sym lookups", s->find_sym_calls, avg_probes, s->find_sym_max_probes);
+    fprintf(stderr, "  %-12s %10zu\n", "lines", s->lines);
+    fprintf(stderr, "  %-12s %10zu\n", "bytes", s->bytes);
+    fprintf(stderr, "  %-12s %10zu\n", "loads elided", s->loads_removed);
+}
+
+/* read back the counts written by a -fprofile-generate build */
+int load_profile(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening profile: %s\n", path);
+        return 1;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    size_t size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+    char* data = (char*)malloc(size + 1);
+    size = fread(data, 1, size, file);
+    fclose(file);
+
+    bool ok = cminus_profile_load(data, size);
+    free(data);
+    if (!ok) {
+        fprintf(stderr, "Error: corrupt profile: %s\n", path);
+        return 1;
+    }
+
     return 0;
-}
\ No newline at end of file
+}
+
+int run(int argc, char **argv) {
+    programArgs args = 0;
+    cminus_flags flags = 0;
+    if (argc < 1) {
+        fprintf(stderr, "%s: fatal error: no input files\n", argv[0]);  
+        return 1;  
+    }
+
+    parse_args(argc, argv, &args, &flags);
+    cminus_stat.enabled = (args & cminus_showStats);
+    if ((flags & cminus_profile_use) && load_profile(cminus_prof.path))
+        return 1;
+    for (size_t index = 1; index < argc; index++) {
+        if (argv[index][0] == '-')
+            continue;
+
+        if (compile_file(argv[index], args, flags))
+            return 1;
+    }
+    
+    int ret = 0;
+    if (!(args & (cminus_asmOnly | cminus_trace)))
+        ret = link_files(argc, argv, args, flags);
+
+    if (args & cminus_showStats)
+        print_stats(args);
+    return ret;
+}
+
+#ifndef _WIN32
+/* $CMINUS_SOCKET, or /tmp/cminus-<uid>.sock */
+void socket_address(struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    char* path = getenv("CMINUS_SOCKET");
+    if (path)
+        snprintf(addr->sun_path, sizeof(addr->sun_path), "%s", path);
+    else
+        snprintf(addr->sun_path, sizeof(addr->sun_path), "/tmp/cminus-%u.sock", (unsigned)getuid());
+}
+
+/* 
+    a request is the client's working directory followed by its arguments, all nul terminated
+    the reply is the output of the compile followed by one byte holding the exit code
+*/
+void serve_client(int client) {
+    size_t len = 0;
+    ssize_t size;
+    while (len < sizeof(string_buffer) - 1 && (size = read(client, string_buffer + len, sizeof(string_buffer) - 1 - len)) > 0)
+        len += size;
+    string_buffer[len] = '\0';
+
+    char* request = malloc(len + 1);
+    memcpy(request, string_buffer, len + 1);
+
+    char* argv[256];
+    int argc = 0;
+    for (char* arg = request + strlen(request) + 1; arg < request + len && argc < 255; arg += strlen(arg) + 1)
+        argv[argc++] = arg;
+    argv[argc] = NULL;
+
+    /* the compile runs in its own process, so a fatal error only ends that compile */
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (chdir(request) != 0)
+            _exit(1);
+
+        dup2(client, STDOUT_FILENO);
+        dup2(client, STDERR_FILENO);
+        snprintf(asm_path, sizeof(asm_path), "/tmp/cminus-%d.asm", (int)getpid());
+        
+        int code = run(argc, argv);
+        fflush(stdout);
+        remove(asm_path);
+        _exit(code);
+    }
+
+    int status = 1;
+    if (pid > 0 && waitpid(pid, &status, 0) == pid)
+        status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+
+    uint8_t code = status;
+    write(client, &code, 1);
+    free(request);
+}
+
+/* stays resident and compiles requests from `cminus --client`, every client is served by a fork */
+int server(void) {
+    struct sockaddr_un addr;
+    socket_address(&addr);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(addr.sun_path);
+
+    /* compiles read and write files as the user running the server, so the socket is only theirs */
+    mode_t mask = umask(077);
+    int bound = (fd < 0) ? -1 : bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(mask);
+    if (bound || listen(fd, 64)) {
+        fprintf(stderr, "cminus: failed to listen on %s\n", addr.sun_path);
+        return 1;
+    }
+
+    signal(SIGCHLD, SIG_IGN);
+    printf("cminus: listening on %s\n", addr.sun_path);
+    fflush(stdout);
+
+    for (;;) {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0)
+            continue;
+
+    #ifdef SO_PEERCRED
+        /* the socket's mode already keeps others out, this also covers a socket directory that doesn't */
+        struct ucred cred;
+        socklen_t cred_len = sizeof(cred);
+        if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) || cred.uid != getuid()) {
+            close(client);
+            continue;
+        }
+    #endif
+
+        if (fork() == 0) {
+            close(fd);
+            signal(SIGCHLD, SIG_DFL);
+            serve_client(client);
+            _exit(0);
+        }
+
+        close(client);
+    }
+}
+
+/* forwards the command line to a running `cminus --server` */
+int client(int argc, char **argv) {
+    struct sockaddr_un addr;
+    socket_address(&addr);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        fprintf(stderr, "cminus: no server on %s\n", addr.sun_path);
+        return 1;
+    }
+
+    if (getcwd(string_buffer, sizeof(string_buffer)) == NULL)
+        return 1;
+
+    size_t len = strlen(string_buffer) + 1;
+    for (int index = 0; index < argc; index++) {
+        size_t size = strlen(argv[index]) + 1;
+        if (len + size > sizeof(string_buffer)) 
+            return 1;
+
+        memcpy(string_buffer + len, argv[index], size);
+        len += size;
+    }
+
+    write(fd, string_buffer, len);
+    shutdown(fd, SHUT_WR);
+
+    /* hold back the last byte, it is the exit code */
+    int code = 1;
+    bool pending = false;
+    char last = 0;
+    ssize_t size;
+    while ((size = read(fd, string_buffer, sizeof(string_buffer))) > 0) {
+        if (pending)
+            fwrite(&last, 1, 1, stdout);
+
+        fwrite(string_buffer, 1, size - 1, stdout);
+        last = string_buffer[size - 1];
+        pending = true;
+    }
+
+    if (pending)
+        code = (uint8_t)last;
+
+    close(fd);
+    return code;
+}
+#endif
+
+#ifdef __linux__
+/* 
+    rebuild the changed inputs and relink, in a fork so a fatal error doesn't end the watch
+    changed is indexed like argv
+*/
+void rebuild(int argc, char **argv, bool* changed, programArgs args, cminus_flags flags) {
+    double start = time_ms();
+    pid_t pid = fork();
+    if (pid == 0) {
+        for (size_t index = 1; index < argc; index++) {
+            if (changed[index] && compile_file(argv[index], args, flags))
+                _exit(1);
+        }
+
+        if (!(args & (cminus_asmOnly | cminus_trace)))
+            link_files(argc, argv, args, flags);
+        fflush(stdout);
+        _exit(0);
+    }
+
+    int status = 1;
+    waitpid(pid, &status, 0);
+    printf("cminus: rebuild %s in %.2f ms\n", (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? "done" : "failed", time_ms() - start);
+    fflush(stdout);
+}
+
+/* an editor replacing a file may not have created the new one yet, so adding its watch is retried for a moment */
+int watch_add(int fd, const char* path, uint32_t mask) {
+    for (size_t tries = 0; tries < 50; tries++) {
+        int wd = inotify_add_watch(fd, path, mask);
+        if (wd >= 0)
+            return wd;
+
+        usleep(10000);
+    }
+
+    fprintf(stderr, "cminus: failed to watch %s\n", path);
+    return -1;
+}
+
+/* watch the inputs with inotify and rebuild whenever one is written */
+int watch(int argc, char **argv) {
+    programArgs args = cminus_timing;
+    cminus_flags flags = 0;
+    parse_args(argc, argv, &args, &flags);
+
+    int fd = inotify_init();
+    if (fd < 0) {
+        fprintf(stderr, "cminus: inotify is not available\n");
+        return 1;
+    }
+
+    int* watches = calloc(argc, sizeof(int));
+    bool* changed = calloc(argc, sizeof(bool));
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB;
+    size_t watching = 0;
+    for (size_t index = 1; index < argc; index++) {
+        if (argv[index][0] == '-')
+            continue;
+
+        watches[index] = inotify_add_watch(fd, argv[index], mask);
+        changed[index] = true;
+        if (watches[index] < 0) {
+            fprintf(stderr, "cminus: failed to watch %s\n", argv[index]);
+            free(watches);
+            free(changed);
+            close(fd);
+            return 1;
+        }
+        watching++;
+    }
+
+    rebuild(argc, argv, changed, args, flags);
+    
+    char events[sizeof(struct inotify_event) * 64 + 0x1000];
+    while (watching) {
+        ssize_t size = read(fd, events, sizeof(events));
+        if (size <= 0)
+            break;
+
+        memset(changed, 0, argc * sizeof(bool));
+        for (char* ptr = events; ptr < events + size; ptr += sizeof(struct inotify_event) + ((struct inotify_event*)ptr)->len) {
+            struct inotify_event* event = (struct inotify_event*)ptr;
+            for (size_t index = 1; index < argc; index++) {
+                if (watches[index] != event->wd || argv[index][0] == '-')
+                    continue;
+                
+                changed[index] = true;
+                /* editors often replace the file, which drops the watch */
+                if (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) {
+                    inotify_rm_watch(fd, watches[index]);
+                    watches[index] = watch_add(fd, argv[index], mask);
+                    if (watches[index] < 0) {
+                        changed[index] = false;
+                        watching--;
+                    }
+                }
+            }
+        }
+
+        rebuild(argc, argv, changed, args, flags);
+    }
+
+    free(watches);
+    free(changed);
+    close(fd);
+    return watching ? 0 : 1;
+}
+#endif
+
+#ifdef __linux__
+typedef struct report_sym {
+    uint64_t addr;
+    const char* name;
+    size_t samples;
+} report_sym;
+
+int report_sym_cmp(const void* a, const void* b) {
+    const report_sym* x = a, *y = b;
+    return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+int report_sym_samples_cmp(const void* a, const void* b) {
+    const report_sym* x = a, *y = b;
+    return (x->samples < y->samples) - (x->samples > y->samples);
+}
+
+char* read_all(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+    char* data = (char*)malloc(*size + 1);
+    *size = fread(data, 1, *size, file);
+    fclose(file);
+    return data;
+}
+
+/* 
+    the function symbols of an executable, from its .symtab
+    nasm's local labels (sys_alloc.large) are skipped, so their samples go to the function they are in
+*/
+#define REPORT_LOAD_SYMS(bits) { \
+        Elf##bits##_Ehdr* ehdr = (Elf##bits##_Ehdr*)elf; \
+        Elf##bits##_Shdr* shdrs = (Elf##bits##_Shdr*)(elf + ehdr->e_shoff); \
+        for (size_t i = 0; i < ehdr->e_shnum; i++) { \
+            if (shdrs[i].sh_type != SHT_SYMTAB) continue; \
+            Elf##bits##_Sym* syms = (Elf##bits##_Sym*)(elf + shdrs[i].sh_offset); \
+            const char* strtab = elf + shdrs[shdrs[i].sh_link].sh_offset; \
+            size_t count = shdrs[i].sh_size / sizeof(Elf##bits##_Sym); \
+            *out = malloc(count * sizeof(report_sym)); \
+            for (size_t j = 0; j < count; j++) { \
+                if (syms[j].st_name == 0 || syms[j].st_shndx == SHN_UNDEF || syms[j].st_shndx >= ehdr->e_shnum) continue; \
+                if (!(shdrs[syms[j].st_shndx].sh_flags & SHF_EXECINSTR)) continue; \
+                if (strchr(strtab + syms[j].st_name, '.')) continue; \
+                (*out)[n++] = (report_sym){syms[j].st_value, strtab + syms[j].st_name, 0}; \
+            } \
+        } \
+    }
+
+size_t report_load_syms(char* elf, size_t size, report_sym** out) {
+    size_t n = 0;
+    *out = NULL;
+    if (size < EI_NIDENT || memcmp(elf, ELFMAG, SELFMAG) != 0)
+        return 0;
+
+    if (elf[EI_CLASS] == ELFCLASS64) REPORT_LOAD_SYMS(64)
+    else REPORT_LOAD_SYMS(32)
+
+    qsort(*out, n, sizeof(report_sym), report_sym_cmp);
+    return n;
+}
+
+/* `cminus --report [a.out] [cminus.pg]`, attributes the samples of a -pg build to its functions */
+int report(int argc, char **argv) {
+    const char* exe = argc > 1 ? argv[1] : "a.out";
+    const char* path = argc > 2 ? argv[2] : "cminus.pg";
+
+    size_t elf_size, size;
+    char* elf = read_all(exe, &elf_size);
+    char* data = read_all(path, &size);
+    if (elf == NULL || data == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", elf ? path : exe);
+        free(elf);
+        free(data);
+        return 1;
+    }
+
+    report_sym* syms;
+    size_t sym_count = report_load_syms(elf, elf_size, &syms);
+    
+    /* the word size, the number of samples taken, then the ring buffer */
+    uint32_t word = 0, taken = 0;
+    if (size >= 8) {
+        memcpy(&word, data, 4);
+        memcpy(&taken, data + 4, 4);
+    }
+
+    if ((word != 4 && word != 8) || sym_count == 0) {
+        fprintf(stderr, "Error: %s isn't a -pg profile of %s\n", path, exe);
+        free(syms);
+        free(elf);
+        free(data);
+        return 1;
+    }
+
+    size_t samples = taken < CMINUS_PG_SAMPLES ? taken : CMINUS_PG_SAMPLES;
+    if (8 + samples * word > size)
+        samples = (size - 8) / word;
+
+    size_t unknown = 0;
+    for (size_t i = 0; i < samples; i++) {
+        uint64_t ip = 0;
+        memcpy(&ip, data + 8 + i * word, word);
+
+        /* the last symbol at or before the sample */
+        size_t lo = 0, hi = sym_count;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (syms[mid].addr <= ip) lo = mid + 1;
+            else hi = mid;
+        }
+
+        if (lo) syms[lo - 1].samples++;
+        else unknown++;
+    }
+
+    qsort(syms, sym_count, sizeof(report_sym), report_sym_samples_cmp);
+    printf("%zu samples (%u taken, 1ms each)\n", samples, taken);
+    printf("%-32s %10s %8s\n", "function", "samples", "%");
+    for (size_t i = 0; i < sym_count && syms[i].samples; i++)
+        printf("%-32s %10zu %7.1f%%\n", syms[i].name, syms[i].samples, syms[i].samples * 100.0 / samples);
+    if (unknown)
+        printf("%-32s %10zu %7.1f%%\n", "(unknown)", unknown, unknown * 100.0 / samples);
+
+    free(syms);
+    free(elf);
+    free(data);
+    return 0;
+}
+#endif
+
+int main(int argc, char **argv) {
+    #ifdef __linux__
+    if (argc > 1 && strcmp(argv[1], "--report") == 0)
+        return report(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "--watch") == 0)
+        return watch(argc - 1, argv + 1);
+    #endif
+
+    #ifndef _WIN32
+    if (argc > 1 && strcmp(argv[1], "--server") == 0)
+        return server();
+    if (argc > 1 && strcmp(argv[1], "--client") == 0)
+        return client(argc - 1, argv + 1);
+    #endif
+
+    return run(argc, argv);
+}